@@ -0,0 +1,116 @@
+#include "Benchmark.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+volatile unsigned int g_benchmarkSink = 0;
+
+//Atomic as the autosave writer thread allocates while the main thread does
+static std::atomic<size_t> g_heapBytes{ 0 };
+static std::atomic<size_t> g_peakHeapBytes{ 0 };
+
+void* operator new(size_t size)
+{
+    size_t* block = static_cast<size_t*>(std::malloc(size + sizeof(max_align_t)));
+    if (block == nullptr)
+        throw std::bad_alloc();
+    *block = size;
+    size_t heapBytes = g_heapBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = g_peakHeapBytes.load(std::memory_order_relaxed);
+    while (heapBytes > peak && !g_peakHeapBytes.compare_exchange_weak(peak, heapBytes, std::memory_order_relaxed))
+    {
+    }
+    return reinterpret_cast<char*>(block) + sizeof(max_align_t);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    if (ptr == nullptr)
+        return;
+    size_t* block = reinterpret_cast<size_t*>(static_cast<char*>(ptr) - sizeof(max_align_t));
+    g_heapBytes.fetch_sub(*block, std::memory_order_relaxed);
+    std::free(block);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+size_t currentHeapBytes()
+{
+    return g_heapBytes.load(std::memory_order_relaxed);
+}
+
+size_t peakHeapBytes()
+{
+    return g_peakHeapBytes.load(std::memory_order_relaxed);
+}
+
+size_t peakRssBytes()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static int usage()
+{
+    std::fprintf(stderr,
+        "usage: Tile-Benchmark <suite> [output.json]\n"
+        "  micro     TileLayer and Grid operations, JSON to output.json or stdout\n"
+        "  render    Grid::render draw list cost in a headless ImGui context, JSON\n"
+        "  storage   chunked TileLayer against the old unordered_map storage (slow)\n");
+    return 2;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+        return usage();
+
+    if (std::strcmp(argv[1], "storage") == 0)
+        return runStorageComparison();
+
+    FILE* json = stdout;
+    if (argc >= 3)
+    {
+        json = std::fopen(argv[2], "w");
+        if (json == nullptr)
+        {
+            std::fprintf(stderr, "cannot write %s\n", argv[2]);
+            return 1;
+        }
+    }
+
+    int result;
+    if (std::strcmp(argv[1], "micro") == 0)
+        result = runMicroBenchmarks(json);
+    else if (std::strcmp(argv[1], "render") == 0)
+        result = runRenderBenchmarks(json);
+    else
+        result = usage();
+
+    if (json != stdout)
+        std::fclose(json);
+    return result;
+}
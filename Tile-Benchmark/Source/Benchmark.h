@@ -0,0 +1,108 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+//Shared helpers of the benchmark suites. Heap usage is tracked by the global operator
+//new/delete replacements in Benchmark.cpp, so every suite sees the bytes it allocates.
+
+size_t currentHeapBytes();
+size_t peakHeapBytes();
+//Peak resident set size of the process as reported by the OS, 0 if unavailable
+size_t peakRssBytes();
+
+//Keeps the optimizer from discarding benchmark results
+extern volatile unsigned int g_benchmarkSink;
+
+class Stopwatch
+{
+private:
+    std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+
+public:
+    double elapsedNs() const
+    {
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count());
+    }
+};
+
+//Minimal JSON emitter for flat result records: {"name": value, ...}
+class JsonRecord
+{
+private:
+    std::string m_text;
+
+    void key(const char* name)
+    {
+        m_text += m_text.empty() ? "{" : ", ";
+        m_text += "\"";
+        m_text += name;
+        m_text += "\": ";
+    }
+
+public:
+    JsonRecord& add(const char* name, const std::string& value)
+    {
+        key(name);
+        m_text += "\"" + value + "\"";
+        return *this;
+    }
+
+    JsonRecord& add(const char* name, const char* value)
+    {
+        return add(name, std::string(value));
+    }
+
+    JsonRecord& add(const char* name, double value)
+    {
+        char number[64];
+        std::snprintf(number, sizeof(number), "%.3f", value);
+        key(name);
+        m_text += number;
+        return *this;
+    }
+
+    JsonRecord& add(const char* name, long long value)
+    {
+        key(name);
+        m_text += std::to_string(value);
+        return *this;
+    }
+
+    JsonRecord& add(const char* name, int value)
+    {
+        return add(name, static_cast<long long>(value));
+    }
+
+    JsonRecord& add(const char* name, size_t value)
+    {
+        return add(name, static_cast<long long>(value));
+    }
+
+    JsonRecord& addRaw(const char* name, const std::string& json)
+    {
+        key(name);
+        m_text += json;
+        return *this;
+    }
+
+    std::string str() const
+    {
+        return m_text.empty() ? "{}" : m_text + "}";
+    }
+};
+
+inline std::string jsonArray(const std::vector<JsonRecord>& records)
+{
+    std::string text = "[";
+    for (size_t i = 0; i < records.size(); ++i)
+        text += (i == 0 ? "\n    " : ",\n    ") + records[i].str();
+    return text + "\n  ]";
+}
+
+//Suites, each returns the process exit code
+int runStorageComparison();
+int runMicroBenchmarks(FILE* json);
+int runRenderBenchmarks(FILE* json);
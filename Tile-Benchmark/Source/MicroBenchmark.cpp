@@ -0,0 +1,546 @@
+#include "Benchmark.h"
+#include "Autosave.h"
+#include "Brush.h"
+#include "Compositor.h"
+#include "Grid.h"
+#include "ProjectFile.h"
+#include "Selection.h"
+#include "Shape.h"
+#include "TileLayer.h"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+//Micro benchmarks of the tile model, one suite per feature, listed in runMicroBenchmarks.
+//Every case reports ns/op and heap bytes per painted tile, and the run ends with the
+//process peak RSS, all as one JSON document so results can be diffed release over release.
+
+namespace
+{
+    constexpr int MAP_SIZE = 1024;
+    constexpr int LAYER_SIZE = 256;
+    constexpr int PROJECT_SIZE = 4096;
+    constexpr int PROJECT_LAYERS = 4;
+    const ImU32 RED = IM_COL32(255, 0, 0, 255);
+
+    using Cells = std::vector<std::pair<int, int>>;
+
+    Cells randomCells(size_t count, int size, unsigned int seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<int> coord(0, size - 1);
+        Cells cells(count);
+        for (auto& cell : cells)
+            cell = { coord(rng), coord(rng) };
+        return cells;
+    }
+
+    //Runs body once, timing it and measuring the heap growth it caused
+    template<typename Body>
+    JsonRecord measure(const char* name, size_t ops, size_t tiles, Body body)
+    {
+        size_t heapBefore = currentHeapBytes();
+        Stopwatch stopwatch;
+        body();
+        double ns = stopwatch.elapsedNs();
+        size_t heapAfter = currentHeapBytes();
+
+        JsonRecord record;
+        record.add("name", name)
+            .add("ops", ops)
+            .add("ns_per_op", ns / static_cast<double>(ops))
+            .add("bytes_per_tile", tiles == 0 ? 0.0 : static_cast<double>(heapAfter > heapBefore ? heapAfter - heapBefore : 0) / static_cast<double>(tiles));
+        return record;
+    }
+
+    unsigned int readAll(const TileLayer& layer, int size)
+    {
+        unsigned int sum = 0;
+        for (int row = 0; row < size; ++row)
+            for (int col = 0; col < size; ++col)
+                sum += layer.getTile(row, col);
+        return sum;
+    }
+
+    //TileLayer::setTile/getTile and fillRect over a MAP_SIZE x MAP_SIZE layer, dense, sparse and clustered
+    void layerBenchmarks(std::vector<JsonRecord>& results)
+    {
+        const size_t mapCells = static_cast<size_t>(MAP_SIZE) * MAP_SIZE;
+        const Cells random = randomCells(mapCells, MAP_SIZE, 1);
+        const Cells sparse = randomCells(mapCells / 100, MAP_SIZE, 2);
+
+        auto dense = std::make_unique<TileLayer>();
+        results.push_back(measure("setTile/sequential/dense", mapCells, mapCells, [&]() {
+            for (int row = 0; row < MAP_SIZE; ++row)
+                for (int col = 0; col < MAP_SIZE; ++col)
+                    dense->setTile(row, col, RED);
+        }));
+        results.push_back(measure("getTile/full_map/dense", mapCells, 0, [&]() {
+            g_benchmarkSink += readAll(*dense, MAP_SIZE);
+        }));
+        dense.reset();
+
+        auto randomLayer = std::make_unique<TileLayer>();
+        results.push_back(measure("setTile/random/dense", random.size(), mapCells, [&]() {
+            for (const auto& cell : random)
+                randomLayer->setTile(cell.first, cell.second, RED);
+        }));
+        randomLayer.reset();
+
+        auto sparseLayer = std::make_unique<TileLayer>();
+        results.push_back(measure("setTile/random/sparse", sparse.size(), sparse.size(), [&]() {
+            for (const auto& cell : sparse)
+                sparseLayer->setTile(cell.first, cell.second, RED);
+        }));
+        results.push_back(measure("getTile/full_map/sparse", mapCells, 0, [&]() {
+            g_benchmarkSink += readAll(*sparseLayer, MAP_SIZE);
+        }));
+        sparseLayer.reset();
+
+        //Painting clustered like a brush stroke rather than scattered over the whole map
+        auto clustered = std::make_unique<TileLayer>();
+        const Cells local = randomCells(mapCells / 100, MAP_SIZE / 10, 3);
+        results.push_back(measure("setTile/random/clustered", local.size(), local.size(), [&]() {
+            for (const auto& cell : local)
+                clustered->setTile(cell.first, cell.second, RED);
+        }));
+        clustered.reset();
+
+        auto filled = std::make_unique<TileLayer>();
+        results.push_back(measure("fillRect/dense", mapCells, mapCells, [&]() {
+            filled->fillRect(0, 0, MAP_SIZE, MAP_SIZE, RED);
+        }));
+    }
+
+    //Grid::setCellColor with each pen size, then brush strokes dragged across the map
+    void gridBenchmarks(std::vector<JsonRecord>& results)
+    {
+        const size_t mapCells = static_cast<size_t>(MAP_SIZE) * MAP_SIZE;
+        const Cells random = randomCells(mapCells / 4, MAP_SIZE, 4);
+
+        for (int pensize = 8; pensize <= 32; pensize *= 2)
+        {
+            int block = pensize / 8;
+            Grid grid(ImVec2(MAP_SIZE * 8.0f, MAP_SIZE * 8.0f), ImVec2(8, 8));
+            std::string name = "Grid::setCellColor/random/pen" + std::to_string(pensize);
+            results.push_back(measure(name.c_str(), random.size(), random.size() * block * block, [&]() {
+                for (const auto& cell : random)
+                    grid.setCellColor(pensize, cell.first / block, cell.second / block, RED);
+            }).add("pen_size", pensize));
+        }
+
+        //A drag sampled once per frame: the mouse moves STROKE_STEP pen cells per frame in a zigzag and
+        //pauses every few frames. Per-frame stamping, as the editor used to, leaves gaps and restamps
+        //paused frames; the stroke joins samples and writes each pen cell it covers once, even where
+        //the zigzag runs back over itself.
+        constexpr int STROKE_FRAMES = 4096;
+        constexpr int STROKE_STEP = 6;
+        constexpr int STROKE_FOOTPRINT = 3;
+        std::vector<std::pair<int, int>> samples;
+        for (int frame = 0; frame < STROKE_FRAMES; ++frame)
+        {
+            int moved = frame - frame / 4;
+            int col = moved * STROKE_STEP % (2 * (MAP_SIZE - STROKE_FOOTPRINT));
+            if (col >= MAP_SIZE - STROKE_FOOTPRINT)
+                col = 2 * (MAP_SIZE - STROKE_FOOTPRINT) - col;
+            samples.push_back({ (moved * STROKE_STEP / MAP_SIZE) % (MAP_SIZE - STROKE_FOOTPRINT), col });
+        }
+        {
+            Grid grid(ImVec2(MAP_SIZE * 8.0f, MAP_SIZE * 8.0f), ImVec2(8, 8));
+            size_t stamps = 0;
+            results.push_back(measure("Grid::setCellColor/drag/per_frame", samples.size(), 0, [&]() {
+                for (const auto& sample : samples)
+                {
+                    for (int i = 0; i < STROKE_FOOTPRINT; ++i)
+                        for (int j = 0; j < STROKE_FOOTPRINT; ++j)
+                            grid.setCellColor(8, sample.first + i, sample.second + j, RED);
+                    stamps += STROKE_FOOTPRINT * STROKE_FOOTPRINT;
+                }
+            }).add("pen_cells_written", stamps));
+        }
+        {
+            Grid grid(ImVec2(MAP_SIZE * 8.0f, MAP_SIZE * 8.0f), ImVec2(8, 8));
+            const Brush brush(BrushShape::Square, STROKE_FOOTPRINT);
+            size_t stamps = 0;
+            results.push_back(measure("Grid::strokeTo/drag", samples.size(), 0, [&]() {
+                grid.beginStroke();
+                for (const auto& sample : samples)
+                    stamps += grid.strokeTo(8, brush, sample.first, sample.second, RED);
+                grid.endStroke();
+            }).add("pen_cells_written", stamps));
+        }
+
+        //The same drag with large brushes, ns/op is the cost of one frame's sample
+        for (int size = 16; size <= Brush::MAX_SIZE; size *= 4)
+        {
+            for (BrushShape shape : { BrushShape::Square, BrushShape::Circle })
+            {
+                Grid grid(ImVec2(MAP_SIZE * 8.0f, MAP_SIZE * 8.0f), ImVec2(8, 8));
+                const Brush brush(shape, size);
+                std::string name = std::string("Grid::strokeTo/drag/") + (shape == BrushShape::Circle ? "circle" : "square") + std::to_string(size);
+                size_t stamps = 0;
+                results.push_back(measure(name.c_str(), samples.size(), 0, [&]() {
+                    grid.beginStroke();
+                    for (const auto& sample : samples)
+                        stamps += grid.strokeTo(8, brush, sample.first, sample.second, RED);
+                    grid.endStroke();
+                }).add("brush_size", size).add("brush_spans", brush.getSpans().size()).add("pen_cells_written", stamps));
+            }
+        }
+    }
+
+    //Layer counts from 1 to 256, each layer holding a dense LAYER_SIZE x LAYER_SIZE block
+    void layerCountBenchmarks(std::vector<JsonRecord>& results)
+    {
+        const size_t layerCells = static_cast<size_t>(LAYER_SIZE) * LAYER_SIZE;
+        for (int layers = 1; layers <= 256; layers *= 2)
+        {
+            auto grid = std::make_unique<Grid>(ImVec2(LAYER_SIZE * 8.0f, LAYER_SIZE * 8.0f), ImVec2(8, 8));
+
+            //The grid starts with one layer
+            results.push_back(measure("Grid::addLayer", layers - 1 > 0 ? layers - 1 : 1, 0, [&]() {
+                for (int i = 1; i < layers; ++i)
+                    grid->addLayer();
+            }).add("layers", layers));
+
+            results.push_back(measure("Grid::setCellColor/sequential/layers", layerCells * layers, layerCells * layers, [&]() {
+                for (int layer = 1; layer <= layers; ++layer)
+                {
+                    grid->selectLayer(layer);
+                    for (int row = 0; row < LAYER_SIZE; ++row)
+                        for (int col = 0; col < LAYER_SIZE; ++col)
+                            grid->setCellColor(8, row, col, RED);
+                }
+            }).add("layers", layers));
+
+            //Bottom layer to the top, a full rotation of the stack
+            results.push_back(measure("Grid::moveLayer", layers, 0, [&]() {
+                for (int i = 0; i < layers; ++i)
+                    grid->moveLayer(grid->getLayers().front().number, layers - 1);
+            }).add("layers", layers));
+
+            results.push_back(measure("Grid::deleteSelectedLayer", layers, 0, [&]() {
+                grid->selectLayer(1);
+                for (int i = 0; i < layers; ++i)
+                    grid->deleteSelectedLayer();
+            }).add("layers", layers));
+        }
+    }
+
+    //A PROJECT_SIZE x PROJECT_SIZE map with one fully painted layer and sparse ones on top.
+    //Opening only maps the file, the first full read after it pays for paging the chunks in.
+    void projectBenchmarks(std::vector<JsonRecord>& results)
+    {
+        const char* path = "micro_benchmark.tileproj";
+        const size_t mapCells = static_cast<size_t>(PROJECT_SIZE) * PROJECT_SIZE;
+        const Cells sparse = randomCells(mapCells / 100, PROJECT_SIZE, 5);
+        size_t painted = mapCells;
+        {
+            Grid grid(ImVec2(PROJECT_SIZE * 8.0f, PROJECT_SIZE * 8.0f), ImVec2(8, 8));
+            grid.findLayer(1)->fillRect(0, 0, PROJECT_SIZE, PROJECT_SIZE, RED);
+            for (int layer = 2; layer <= PROJECT_LAYERS; ++layer)
+            {
+                grid.addLayer();
+                for (const auto& cell : sparse)
+                    grid.findLayer(layer)->setTile(cell.first, cell.second, RED);
+                painted += sparse.size();
+            }
+
+            results.push_back(measure("saveProject", 1, 0, [&]() {
+                if (!saveProject(grid, path))
+                    std::fprintf(stderr, "cannot write %s\n", path);
+            }).add("map_size", PROJECT_SIZE).add("layers", PROJECT_LAYERS));
+        }
+
+        auto grid = std::make_unique<Grid>(ImVec2(8, 8), ImVec2(8, 8));
+        results.push_back(measure("loadProject", 1, 0, [&]() {
+            if (!loadProject(path, *grid))
+                std::fprintf(stderr, "cannot read %s\n", path);
+        }).add("map_size", PROJECT_SIZE).add("layers", PROJECT_LAYERS));
+
+        results.push_back(measure("getTile/full_map/after_load", mapCells * PROJECT_LAYERS, painted, [&]() {
+            for (int layer = 1; layer <= PROJECT_LAYERS; ++layer)
+                g_benchmarkSink += readAll(*grid->findLayer(layer), PROJECT_SIZE);
+        }).add("map_size", PROJECT_SIZE).add("layers", PROJECT_LAYERS));
+
+        grid.reset();
+        std::remove(path);
+    }
+
+    //Paints a PROJECT_SIZE x PROJECT_SIZE layer row by row under a budget of an eighth of it,
+    //trimming like the editor does once per frame, here once per painted row, then reads it back.
+    void outOfCoreBenchmarks(std::vector<JsonRecord>& results)
+    {
+        const size_t mapCells = static_cast<size_t>(PROJECT_SIZE) * PROJECT_SIZE;
+        const size_t budget = mapCells / TILE_CHUNK_CELLS * sizeof(TileChunk) / 8;
+        auto grid = std::make_unique<Grid>(ImVec2(PROJECT_SIZE * 8.0f, PROJECT_SIZE * 8.0f), ImVec2(8, 8));
+        grid->setChunkBudget(budget);
+        TileLayer& layer = *grid->findLayer(1);
+
+        size_t evicted = 0;
+        results.push_back(measure("setTile/sequential/budget", mapCells, mapCells, [&]() {
+            for (int row = 0; row < PROJECT_SIZE; ++row)
+            {
+                for (int col = 0; col < PROJECT_SIZE; ++col)
+                    layer.setTile(row, col, RED);
+                evicted += grid->trimResidentChunks();
+            }
+        }).add("budget_bytes", budget).add("evicted_chunks", evicted));
+
+        evicted = 0;
+        results.push_back(measure("getTile/full_map/budget", mapCells, 0, [&]() {
+            for (int row = 0; row < PROJECT_SIZE; ++row)
+            {
+                for (int col = 0; col < PROJECT_SIZE; ++col)
+                    g_benchmarkSink += layer.getTile(row, col);
+                evicted += grid->trimResidentChunks();
+            }
+        }).add("budget_bytes", budget).add("evicted_chunks", evicted));
+    }
+
+    //Journals a dense MAP_SIZE x MAP_SIZE layer. Each Autosave::update call stands for one frame,
+    //the longest one shows how much an autosave cycle can hold up the render loop. No heap figure is
+    //reported, the writer thread allocates while it runs.
+    void autosaveBenchmarks(std::vector<JsonRecord>& results)
+    {
+        const char* path = "micro_benchmark.journal";
+        const size_t mapCells = static_cast<size_t>(MAP_SIZE) * MAP_SIZE;
+        Grid grid(ImVec2(MAP_SIZE * 8.0f, MAP_SIZE * 8.0f), ImVec2(8, 8));
+        grid.findLayer(1)->fillRect(0, 0, MAP_SIZE, MAP_SIZE, RED);
+
+        double maxUpdateNs = 0.0;
+        int frames = 0;
+        {
+            Autosave autosave(path);
+            autosave.setInterval(std::chrono::steady_clock::duration::zero());
+            autosave.restart(grid);
+            results.push_back(measure("Autosave::update/dense", mapCells / TILE_CHUNK_CELLS, 0, [&]() {
+                while (grid.findLayer(1)->hasUnsaved())
+                {
+                    Stopwatch frame;
+                    autosave.update(grid);
+                    maxUpdateNs = std::max(maxUpdateNs, frame.elapsedNs());
+                    ++frames;
+                }
+            }).add("frames", frames).add("max_update_ns", maxUpdateNs));
+        }
+        std::remove(path);
+    }
+
+    //Bucket fill of a FILL_SIZE x FILL_SIZE canvas scattered with painted cells, which the
+    //region has to flow around, with 4 and 8 connectivity and sampling every visible layer
+    void floodFillBenchmarks(std::vector<JsonRecord>& results)
+    {
+        constexpr int FILL_SIZE = 2048;
+        const Cells obstacles = randomCells(static_cast<size_t>(FILL_SIZE) * FILL_SIZE / 64, FILL_SIZE, 12);
+        for (int variant = 0; variant < 3; ++variant)
+        {
+            const bool diagonal = variant == 1;
+            const bool sampleVisibleLayers = variant == 2;
+            Grid grid(ImVec2(FILL_SIZE * 8.0f, FILL_SIZE * 8.0f), ImVec2(8, 8));
+            for (const auto& cell : obstacles)
+                grid.findLayer(1)->setTile(cell.first, cell.second, IM_COL32(0, 0, 255, 255));
+            if (sampleVisibleLayers)
+                grid.addLayer();
+
+            size_t filled = 0;
+            const char* name = sampleVisibleLayers ? "Grid::floodFill/visible_layers" : diagonal ? "Grid::floodFill/8" : "Grid::floodFill/4";
+            JsonRecord record = measure(name, 1, 0, [&]() {
+                filled = grid.floodFill(FILL_SIZE / 2, FILL_SIZE / 2 + 1, RED, diagonal, sampleVisibleLayers);
+            });
+            results.push_back(record.add("filled_cells", filled));
+        }
+    }
+
+    //Shapes spanning the whole MAP_SIZE x MAP_SIZE map, rasterized and committed with history as the
+    //editor does on mouse release
+    void shapeBenchmarks(std::vector<JsonRecord>& results)
+    {
+        const struct
+        {
+            const char* name;
+            ShapeKind kind;
+        } shapes[] = {
+            { "Grid::paintSpans/rectangle", ShapeKind::Rectangle },
+            { "Grid::paintSpans/filled_rectangle", ShapeKind::FilledRectangle },
+            { "Grid::paintSpans/ellipse", ShapeKind::Ellipse },
+            { "Grid::paintSpans/filled_ellipse", ShapeKind::FilledEllipse },
+            { "Grid::paintSpans/line", ShapeKind::Line },
+        };
+        for (const auto& shape : shapes)
+        {
+            Grid grid(ImVec2(MAP_SIZE * 8.0f, MAP_SIZE * 8.0f), ImVec2(8, 8));
+            std::vector<TileSpan> spans;
+            size_t cells = 0;
+            results.push_back(measure(shape.name, 1, 0, [&]() {
+                rasterizeShape(shape.kind, 0, 0, MAP_SIZE - 1, MAP_SIZE - 1, spans);
+                grid.paintSpans(spans, RED);
+            }).add("spans", spans.size()));
+            for (const TileSpan& span : spans)
+                cells += span.lastCol - span.firstCol;
+            results.back().add("cells", cells);
+        }
+    }
+
+    //Copy, lift, drop and paste of a SELECTION_SIZE x SELECTION_SIZE selection of a layer scattered
+    //with painted cells. The lift and the drop each read and write every selected tile once.
+    void selectionBenchmarks(std::vector<JsonRecord>& results)
+    {
+        constexpr int SELECTION_SIZE = 2048;
+        const size_t selectionCells = static_cast<size_t>(SELECTION_SIZE) * SELECTION_SIZE;
+        Grid grid(ImVec2(SELECTION_SIZE * 8.0f, SELECTION_SIZE * 8.0f), ImVec2(8, 8));
+        grid.findLayer(1)->fillRect(0, 0, SELECTION_SIZE, SELECTION_SIZE, IM_COL32(0, 0, 255, 255));
+        for (const auto& cell : randomCells(selectionCells / 16, SELECTION_SIZE, 13))
+            grid.findLayer(1)->setTile(cell.first, cell.second, RED);
+
+        TileSelection selection;
+        selection.select(grid, 0, 0, SELECTION_SIZE - 1, SELECTION_SIZE - 1);
+        results.push_back(measure("TileSelection::copy", 1, 0, [&]() {
+            selection.copy(grid);
+        }).add("cells", selectionCells));
+        results.push_back(measure("TileSelection::lift", 1, 0, [&]() {
+            selection.lift(grid);
+        }).add("cells", selectionCells));
+        selection.moveBy(SELECTION_SIZE / 4, SELECTION_SIZE / 4);
+        results.push_back(measure("TileSelection::drop/moved", 1, 0, [&]() {
+            selection.drop(grid);
+        }).add("history_bytes", grid.getHistory().getMemoryBytes()));
+        results.push_back(measure("TileSelection::paste", 1, 0, [&]() {
+            selection.paste(grid);
+            selection.drop(grid);
+        }).add("cells", selectionCells));
+        results.push_back(measure("TileHistory::undo/paste", 1, 0, [&]() {
+            grid.undo();
+        }));
+    }
+
+    //Blend kernels over random pixels, every alpha from 0 to 255 included. Each SIMD kernel compiled in
+    //is checked against the scalar one: bit_exact is 1 when every output pixel matches, and the run
+    //fails when one does not. CompositorTest checks the same with edge values under ctest.
+    //Then LayerCompositor::composite of a map of COMPOSITE_LAYERS half painted, translucent layers,
+    //blended from scratch and then served from the cache. Returns false on a kernel mismatch.
+    bool compositorBenchmarks(std::vector<JsonRecord>& results)
+    {
+        constexpr int BLEND_PIXELS = 1 << 20;
+        constexpr int BLEND_PASSES = 16;
+        std::mt19937 rng(14);
+        std::vector<ImU32> source(BLEND_PIXELS);
+        std::vector<uint32_t> base(BLEND_PIXELS);
+        for (int i = 0; i < BLEND_PIXELS; ++i)
+        {
+            source[i] = (rng() & 0x00FFFFFFu) | static_cast<uint32_t>(i % 256) << IM_COL32_A_SHIFT;
+            //Premultiplied destination: no channel above alpha
+            uint32_t alpha = rng() % 256;
+            base[i] = alpha << IM_COL32_A_SHIFT;
+            for (int shift = 0; shift < IM_COL32_A_SHIFT; shift += 8)
+                base[i] |= (alpha == 0 ? 0 : rng() % (alpha + 1)) << shift;
+        }
+
+        std::vector<uint32_t> expected = base;
+        blendOverScalar(expected.data(), source.data(), BLEND_PIXELS);
+
+        const struct
+        {
+            const char* name;
+            void (*blend)(uint32_t*, const ImU32*, int);
+        } kernels[] = {
+            { "blendOverScalar", blendOverScalar },
+#if defined(TILE_SSE2)
+            { "blendOverSse2", blendOverSse2 },
+#endif
+#if defined(TILE_AVX2)
+            { "blendOverAvx2", blendOverAvx2 },
+#endif
+        };
+        bool allExact = true;
+        for (const auto& kernel : kernels)
+        {
+            std::vector<uint32_t> pixels = base;
+            kernel.blend(pixels.data(), source.data(), BLEND_PIXELS);
+            bool exact = pixels == expected;
+            if (!exact)
+                std::fprintf(stderr, "%s does not match blendOverScalar\n", kernel.name);
+            allExact &= exact;
+            results.push_back(measure(kernel.name, static_cast<size_t>(BLEND_PIXELS) * BLEND_PASSES, 0, [&]() {
+                for (int pass = 0; pass < BLEND_PASSES; ++pass)
+                    kernel.blend(pixels.data(), source.data(), BLEND_PIXELS);
+            }).add("bit_exact", exact ? 1 : 0));
+        }
+
+        constexpr int COMPOSITE_LAYERS = 8;
+        std::vector<std::unique_ptr<TileLayer>> layers;
+        std::vector<const TileLayer*> visible;
+        for (int layer = 0; layer < COMPOSITE_LAYERS; ++layer)
+        {
+            layers.push_back(std::make_unique<TileLayer>());
+            for (const auto& cell : randomCells(static_cast<size_t>(MAP_SIZE) * MAP_SIZE / 2, MAP_SIZE, 20 + layer))
+                layers.back()->setTile(cell.first, cell.second, IM_COL32(rng() % 256, rng() % 256, rng() % 256, 128 + rng() % 128));
+            visible.push_back(layers.back().get());
+        }
+
+        const int chunks = MAP_SIZE / TILE_CHUNK_SIZE;
+        LayerCompositor compositor;
+        const char* names[] = { "LayerCompositor::composite/blend", "LayerCompositor::composite/cached" };
+        for (const char* name : names)
+        {
+            compositor.beginFrame();
+            results.push_back(measure(name, static_cast<size_t>(chunks) * chunks, 0, [&]() {
+                for (int chunkRow = 0; chunkRow < chunks; ++chunkRow)
+                    for (int chunkCol = 0; chunkCol < chunks; ++chunkCol)
+                        compositor.composite(visible, chunkRow, chunkCol);
+            }).add("layers", COMPOSITE_LAYERS).add("composites", compositor.getCompositeCount()));
+        }
+        return allExact;
+    }
+
+    //One pen block of HISTORY_FILL x HISTORY_FILL tiles over a painted layer, undone and redone as a whole.
+    //bytes_per_tile of the fill is mostly the history record of the old cells.
+    void historyBenchmarks(std::vector<JsonRecord>& results)
+    {
+        constexpr int HISTORY_FILL = 320;
+        const size_t fillCells = static_cast<size_t>(HISTORY_FILL) * HISTORY_FILL;
+        Grid grid(ImVec2(MAP_SIZE * 8.0f, MAP_SIZE * 8.0f), ImVec2(8, 8));
+        for (const auto& cell : randomCells(fillCells / 4, HISTORY_FILL, 11))
+            grid.findLayer(1)->setTile(cell.first, cell.second, IM_COL32(0, 0, 255, 255));
+
+        results.push_back(measure("Grid::setCellColor/recorded", 1, fillCells, [&]() {
+            grid.setCellColor(HISTORY_FILL * 8, 0, 0, RED);
+        }).add("history_bytes", grid.getHistory().getMemoryBytes()));
+        results.push_back(measure("TileHistory::undo/fill", 1, 0, [&]() {
+            grid.undo();
+        }));
+        results.push_back(measure("TileHistory::redo/fill", 1, 0, [&]() {
+            grid.redo();
+        }));
+    }
+}
+
+int runMicroBenchmarks(FILE* json)
+{
+    std::vector<JsonRecord> results;
+    layerBenchmarks(results);
+    gridBenchmarks(results);
+    layerCountBenchmarks(results);
+    projectBenchmarks(results);
+    outOfCoreBenchmarks(results);
+    autosaveBenchmarks(results);
+    historyBenchmarks(results);
+    floodFillBenchmarks(results);
+    shapeBenchmarks(results);
+    selectionBenchmarks(results);
+    bool kernelsExact = compositorBenchmarks(results);
+
+    JsonRecord report;
+    report.add("suite", "micro")
+        .add("map_size", MAP_SIZE)
+        .add("chunk_size", TILE_CHUNK_SIZE)
+        .addRaw("results", jsonArray(results))
+        .add("peak_heap_bytes", peakHeapBytes())
+        .add("peak_rss_bytes", peakRssBytes());
+    std::fprintf(json, "%s\n", report.str().c_str());
+    return kernelsExact ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+#include "Benchmark.h"
+#include "Grid.h"
+#include "Selection.h"
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//Headless render path benchmark: an ImGui context without a window or renderer backend
+//runs whole frames around Grid::render on synthetic maps. Reports the draw data the
+//renderer would receive (vertices, indices, draw commands) and the time per frame, both
+//for Grid::render alone and for the NewFrame to Render span. The floating cases drag a lifted
+//selection of the whole map a tile per frame, the preview of a multi-million tile move. The
+//composite cases draw the layers flattened by the compositor, one textured quad per chunk.
+
+namespace
+{
+    const ImVec2 DISPLAY_SIZE(1920.0f, 1080.0f);
+    const ImVec2 TILE_SIZE(8.0f, 8.0f);
+    constexpr int WARMUP_FRAMES = 2;
+    constexpr int TIMED_FRAMES = 50;
+
+    enum class Pattern
+    {
+        Solid,   //one colour everywhere, the best case for greedy meshing
+        Stripes, //a colour per row, one quad per chunk row
+        Noise,   //random colours on half of the cells, close to one quad per tile
+    };
+
+    const char* patternName(Pattern pattern)
+    {
+        switch (pattern)
+        {
+        case Pattern::Solid: return "solid";
+        case Pattern::Stripes: return "stripes";
+        default: return "noise";
+        }
+    }
+
+    void paintLayer(TileLayer& layer, int mapSize, Pattern pattern, unsigned int seed)
+    {
+        if (pattern == Pattern::Solid)
+        {
+            layer.fillRect(0, 0, mapSize, mapSize, IM_COL32(200, 60, 60, 255));
+            return;
+        }
+
+        if (pattern == Pattern::Stripes)
+        {
+            for (int row = 0; row < mapSize; ++row)
+                layer.fillRect(row, 0, row + 1, mapSize, row % 2 ? IM_COL32(60, 200, 60, 255) : IM_COL32(60, 60, 200, 255));
+            return;
+        }
+
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<unsigned int> channel(0, 255);
+        for (int row = 0; row < mapSize; ++row)
+            for (int col = 0; col < mapSize; ++col)
+                if (rng() & 1)
+                    layer.setTile(row, col, IM_COL32(channel(rng), channel(rng), channel(rng), 255));
+    }
+
+    std::unique_ptr<Grid> makeGrid(int mapSize, int layers, Pattern pattern)
+    {
+        auto grid = std::make_unique<Grid>(ImVec2(mapSize * TILE_SIZE.x, mapSize * TILE_SIZE.y), TILE_SIZE);
+        for (int i = 1; i < layers; ++i)
+            grid->addLayer();
+        for (int i = 1; i <= layers; ++i)
+            paintLayer(*grid->findLayer(i), mapSize, pattern, i);
+        return grid;
+    }
+
+    //Stands in for the editor's ChunkTextures: counts uploads and hands out the font atlas
+    class CountingTextures : public CompositeTextures
+    {
+    private:
+        std::unordered_map<uint64_t, uint64_t> m_revisions;
+
+    public:
+        size_t uploads = 0;
+
+        ImTextureID getTexture(int chunkRow, int chunkCol, const CompositeChunk& chunk) override
+        {
+            uint64_t& revision = m_revisions[static_cast<uint64_t>(static_cast<uint32_t>(chunkRow)) << 32 | static_cast<uint32_t>(chunkCol)];
+            if (revision != chunk.revision)
+            {
+                revision = chunk.revision;
+                ++uploads;
+            }
+            return ImGui::GetIO().Fonts->TexID;
+        }
+    };
+
+    struct FrameStats
+    {
+        double renderNs = 0.0;
+        double frameNs = 0.0;
+        int vertices = 0;
+        int indices = 0;
+        int commands = 0;
+        int quads = 0;
+    };
+
+    //One frame with the canvas filling the display, the same clip rect the editor's
+    //"GridChild" gets when the map is larger than the window
+    FrameStats runFrame(Grid& grid, bool showGrid, float gridThickness, TileSelection* selection)
+    {
+        FrameStats stats;
+        Stopwatch frame;
+        ImGui::NewFrame();
+        ImGui::SetNextWindowPos(ImVec2(0, 0));
+        ImGui::SetNextWindowSize(DISPLAY_SIZE);
+        ImGui::Begin("Canvas", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoBackground);
+
+        Stopwatch render;
+        grid.render(ImGui::GetWindowDrawList(), TILE_SIZE, -1, -1, showGrid, gridThickness);
+        if (selection != nullptr)
+        {
+            selection->moveBy(1, 1);
+            selection->render(grid, ImGui::GetWindowDrawList());
+        }
+        stats.renderNs = render.elapsedNs();
+
+        ImGui::End();
+        ImGui::Render();
+        stats.frameNs = frame.elapsedNs();
+
+        const ImDrawData* drawData = ImGui::GetDrawData();
+        stats.vertices = drawData->TotalVtxCount;
+        stats.indices = drawData->TotalIdxCount;
+        for (int i = 0; i < drawData->CmdListsCount; ++i)
+            stats.commands += drawData->CmdLists[i]->CmdBuffer.Size;
+        stats.quads = grid.getEmittedQuadCount();
+        return stats;
+    }
+
+    JsonRecord runCase(Grid& grid, int mapSize, int layers, Pattern pattern, bool showGrid, float gridThickness, TileSelection* selection = nullptr)
+    {
+        for (int i = 0; i < WARMUP_FRAMES; ++i)
+            runFrame(grid, showGrid, gridThickness, selection);
+
+        FrameStats total;
+        FrameStats last;
+        for (int i = 0; i < TIMED_FRAMES; ++i)
+        {
+            last = runFrame(grid, showGrid, gridThickness, selection);
+            total.renderNs += last.renderNs;
+            total.frameNs += last.frameNs;
+        }
+
+        JsonRecord record;
+        record.add("map_size", mapSize)
+            .add("layers", layers)
+            .add("pattern", patternName(pattern))
+            .add("show_grid", showGrid ? 1 : 0)
+            .add("grid_thickness", static_cast<double>(gridThickness))
+            .add("floating", selection != nullptr ? 1 : 0)
+            .add("tile_quads", last.quads)
+            .add("vertices", last.vertices)
+            .add("indices", last.indices)
+            .add("draw_commands", last.commands)
+            .add("render_us_per_frame", total.renderNs / TIMED_FRAMES / 1000.0)
+            .add("frame_us_per_frame", total.frameNs / TIMED_FRAMES / 1000.0);
+        return record;
+    }
+}
+
+int runRenderBenchmarks(FILE* json)
+{
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGuiIO& io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    io.DisplaySize = DISPLAY_SIZE;
+    io.DeltaTime = 1.0f / 60.0f;
+    //The renderer backend sets this in the editor, large draw lists depend on it
+    io.BackendFlags |= ImGuiBackendFlags_RendererHasVtxOffset;
+
+    //No texture is uploaded, the atlas only has to exist for NewFrame
+    unsigned char* pixels;
+    int width, height;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+    std::vector<JsonRecord> results;
+    const int mapSizes[] = { 64, 256, 1024 };
+    const int layerCounts[] = { 1, 4, 16 };
+    const Pattern patterns[] = { Pattern::Solid, Pattern::Stripes, Pattern::Noise };
+    const float thicknesses[] = { 1.0f, 2.0f, 4.0f };
+
+    for (int mapSize : mapSizes)
+    {
+        for (int layers : layerCounts)
+        {
+            for (Pattern pattern : patterns)
+            {
+                auto grid = makeGrid(mapSize, layers, pattern);
+                results.push_back(runCase(*grid, mapSize, layers, pattern, false, 1.0f));
+                for (float thickness : thicknesses)
+                    results.push_back(runCase(*grid, mapSize, layers, pattern, true, thickness));
+            }
+        }
+    }
+
+    for (int layers : layerCounts)
+    {
+        for (Pattern pattern : patterns)
+        {
+            auto grid = makeGrid(1024, layers, pattern);
+            CountingTextures textures;
+            grid->setCompositeTextures(&textures);
+            results.push_back(runCase(*grid, 1024, layers, pattern, false, 1.0f).add("composite", 1).add("texture_uploads", textures.uploads));
+        }
+    }
+
+    constexpr int FLOATING_SIZE = 2048;
+    for (Pattern pattern : patterns)
+    {
+        auto grid = makeGrid(FLOATING_SIZE, 1, pattern);
+        TileSelection selection;
+        selection.select(*grid, 0, 0, FLOATING_SIZE - 1, FLOATING_SIZE - 1);
+        selection.lift(*grid);
+        results.push_back(runCase(*grid, FLOATING_SIZE, 1, pattern, false, 1.0f, &selection));
+        selection.drop(*grid);
+    }
+
+    ImGui::DestroyContext();
+
+    JsonRecord report;
+    report.add("suite", "render")
+        .add("display_width", static_cast<int>(DISPLAY_SIZE.x))
+        .add("display_height", static_cast<int>(DISPLAY_SIZE.y))
+        .add("tile_size", static_cast<int>(TILE_SIZE.x))
+        .add("frames", TIMED_FRAMES)
+        .addRaw("results", jsonArray(results))
+        .add("peak_heap_bytes", peakHeapBytes())
+        .add("peak_rss_bytes", peakRssBytes());
+    std::fprintf(json, "%s\n", report.str().c_str());
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "Benchmark.h"
+#include "TileLayer.h"
+#include <random>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+//Compares the chunked TileLayer against the tuple keyed unordered_map it replaced
+//on a 1024 x 1024 map: dense sequential painting, random painting, full map reads
+//and sparse painting, reporting time per cell and heap bytes in use.
+//The map baseline takes minutes on a dense map: its XOR hash maps every (row, col)
+//with the same row ^ col into one bucket.
+
+template<>
+struct std::hash<std::tuple<int, int, int>> {
+    size_t operator()(const std::tuple<int, int, int>  cellCoord) const
+    {
+        return std::hash<int>()(get<0>(cellCoord)) ^ std::hash<int>()(get<1>(cellCoord)) ^ std::hash<int>()(get<2>(cellCoord));
+    }
+};
+
+constexpr int MAP_SIZE = 1024;
+constexpr int PEN_SIZE = 8;
+
+//The storage TileLayer used before chunking and packed cells, kept here as the baseline.
+//Cells were keyed by pen size as well; the benchmark paints with the smallest pen.
+class MapTileLayer
+{
+private:
+    std::unordered_map<std::tuple<int, int, int>, ImVec4> m_cellColors;
+
+public:
+    void setTile(int row, int col, const ImVec4& color) {
+        m_cellColors[std::make_tuple(PEN_SIZE, row, col)] = color;
+    }
+
+    ImVec4 getTile(int row, int col) const
+    {
+        auto it = m_cellColors.find(std::make_tuple(PEN_SIZE, row, col));
+        if (it != m_cellColors.end())
+            return it->second;
+        else
+            return ImVec4(0, 0, 0, 0);
+    }
+};
+
+
+struct Result
+{
+    double nsPerCell;
+    size_t bytes;
+};
+
+template<typename Layer, typename Body>
+Result measure(Layer& layer, size_t cells, Body body)
+{
+    size_t heapBefore = currentHeapBytes();
+    Stopwatch stopwatch;
+    body(layer);
+    double ns = stopwatch.elapsedNs();
+    return { ns / cells, currentHeapBytes() - heapBefore };
+}
+
+static float alphaOf(const ImVec4& color)
+{
+    return color.w;
+}
+
+static float alphaOf(ImU32 color)
+{
+    return static_cast<float>((color >> IM_COL32_A_SHIFT) & 0xFF);
+}
+
+template<typename Layer, typename Cell>
+void runSuite(const char* name, Cell color, const std::vector<std::pair<int, int>>& randomCells, const std::vector<std::pair<int, int>>& sparseCells)
+{
+    const size_t mapCells = static_cast<size_t>(MAP_SIZE) * MAP_SIZE;
+
+    Layer dense;
+    Result sequential = measure(dense, mapCells, [&](Layer& layer) {
+        for (int row = 0; row < MAP_SIZE; ++row)
+            for (int col = 0; col < MAP_SIZE; ++col)
+                layer.setTile(row, col, color);
+    });
+
+    Result read = measure(dense, mapCells, [&](Layer& layer) {
+        float sum = 0.0f;
+        for (int row = 0; row < MAP_SIZE; ++row)
+            for (int col = 0; col < MAP_SIZE; ++col)
+                sum += alphaOf(layer.getTile(row, col));
+        g_benchmarkSink += static_cast<unsigned int>(sum);
+    });
+
+    Layer random;
+    Result randomWrite = measure(random, randomCells.size(), [&](Layer& layer) {
+        for (const auto& cell : randomCells)
+            layer.setTile(cell.first, cell.second, color);
+    });
+
+    Layer sparse;
+    Result sparseWrite = measure(sparse, sparseCells.size(), [&](Layer& layer) {
+        for (const auto& cell : sparseCells)
+            layer.setTile(cell.first, cell.second, color);
+    });
+
+    std::printf("%-10s %12.2f %12.2f %12.2f %12.2f %14zu %14zu\n", name,
+        sequential.nsPerCell, randomWrite.nsPerCell, read.nsPerCell, sparseWrite.nsPerCell,
+        sequential.bytes, sparseWrite.bytes);
+}
+
+int runStorageComparison()
+{
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> coord(0, MAP_SIZE - 1);
+
+    std::vector<std::pair<int, int>> randomCells(static_cast<size_t>(MAP_SIZE) * MAP_SIZE);
+    for (auto& cell : randomCells)
+        cell = { coord(rng), coord(rng) };
+
+    //Roughly 1% of the map, the typical coverage of a freshly started layer
+    std::vector<std::pair<int, int>> sparseCells(static_cast<size_t>(MAP_SIZE) * MAP_SIZE / 100);
+    for (auto& cell : sparseCells)
+        cell = { coord(rng), coord(rng) };
+
+    std::printf("%d x %d map\n", MAP_SIZE, MAP_SIZE);
+    std::printf("%-10s %12s %12s %12s %12s %14s %14s\n", "storage",
+        "seq ns/op", "rand ns/op", "read ns/op", "sparse ns/op", "dense bytes", "sparse bytes");
+    runSuite<MapTileLayer>("map", ImVec4(1.0f, 0.0f, 0.0f, 1.0f), randomCells, sparseCells);
+    runSuite<TileLayer>("chunked", IM_COL32(255, 0, 0, 255), randomCells, sparseCells);
+    return 0;
+}
@@ -0,0 +1,517 @@
+#include "Autosave.h"
+#include "Grid.h"
+#include "MappedFile.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+    constexpr char JOURNAL_MAGIC[8] = { 'T', 'I', 'L', 'E', 'J', 'R', 'N', '\0' };
+    constexpr uint32_t JOURNAL_VERSION = 1;
+    constexpr uint64_t JOURNAL_HEADER_BYTES = 16;
+
+    constexpr uint32_t RECORD_RESET = 1;
+    constexpr uint32_t RECORD_LAYERS = 2;
+    constexpr uint32_t RECORD_CHUNK = 3;
+    constexpr uint32_t RECORD_HEADER_BYTES = 8;
+    constexpr uint32_t RESET_BYTES = 4 * sizeof(float);
+    constexpr uint32_t CHUNK_KEY_BYTES = 3 * sizeof(int32_t);
+    constexpr uint32_t CHUNK_CELL_BYTES = sizeof(ImU32) * TILE_CHUNK_CELLS;
+    constexpr uint64_t CHUNK_RECORD_BYTES = RECORD_HEADER_BYTES + CHUNK_KEY_BYTES + CHUNK_CELL_BYTES;
+
+    //Chunks collected per takeUnsaved call, the collect budget is checked in between
+    constexpr size_t COLLECT_STEP = 16;
+    //Pending bytes are queued once they reach this, so the buffer never reallocates a large block
+    constexpr size_t BATCH_BYTES = 1 << 20;
+    //Compaction runs once the journal is this large and at least half of it is superseded
+    constexpr uint64_t COMPACT_MIN_BYTES = 16 << 20;
+
+    template<typename Value>
+    void append(std::vector<unsigned char>& bytes, const Value& value)
+    {
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(&value);
+        bytes.insert(bytes.end(), data, data + sizeof(Value));
+    }
+
+    template<typename Value>
+    Value readAt(const unsigned char* bytes)
+    {
+        Value value;
+        std::memcpy(&value, bytes, sizeof(Value));
+        return value;
+    }
+
+    void appendChunk(std::vector<unsigned char>& bytes, int layer, int chunkRow, int chunkCol, const ImU32* cells)
+    {
+        append(bytes, RECORD_CHUNK);
+        append(bytes, cells != nullptr ? CHUNK_KEY_BYTES + CHUNK_CELL_BYTES : CHUNK_KEY_BYTES);
+        append(bytes, static_cast<int32_t>(layer));
+        append(bytes, static_cast<int32_t>(chunkRow));
+        append(bytes, static_cast<int32_t>(chunkCol));
+        if (cells != nullptr)
+        {
+            const unsigned char* data = reinterpret_cast<const unsigned char*>(cells);
+            bytes.insert(bytes.end(), data, data + CHUNK_CELL_BYTES);
+        }
+    }
+
+    //Payload sizes each record type may have
+    bool isValidRecord(uint32_t type, uint32_t size)
+    {
+        switch (type)
+        {
+        case RECORD_RESET:
+            return size == RESET_BYTES;
+        case RECORD_LAYERS:
+            return size >= sizeof(int32_t) && (size - sizeof(int32_t)) % (2 * sizeof(int32_t)) == 0;
+        case RECORD_CHUNK:
+            return size == CHUNK_KEY_BYTES || size == CHUNK_KEY_BYTES + CHUNK_CELL_BYTES;
+        default:
+            return false;
+        }
+    }
+
+    bool seek(FILE* file, uint64_t offset)
+    {
+#if defined(_MSC_VER)
+        return _fseeki64(file, static_cast<long long>(offset), SEEK_SET) == 0;
+#else
+        return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+    }
+
+    bool writeHeader(FILE* file)
+    {
+        uint32_t version[2] = { JOURNAL_VERSION, 0 };
+        return std::fwrite(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC), 1, file) == 1 && std::fwrite(version, sizeof(version), 1, file) == 1;
+    }
+}
+
+Autosave::Autosave(std::string journalPath) : m_path(std::move(journalPath))
+{
+}
+
+Autosave::~Autosave()
+{
+    stopWriter();
+}
+
+void Autosave::close()
+{
+    TILE_TRACE_SCOPE("Autosave::close");
+    //Batches not written yet would only be removed with the journal
+    m_pending.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.clear();
+    }
+    stopWriter();
+    if (m_file != nullptr)
+    {
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+    std::remove(m_path.c_str());
+}
+
+bool Autosave::recover(Grid& grid)
+{
+    TILE_TRACE_SCOPE("Autosave::recover");
+    std::shared_ptr<const MappedFile> file = MappedFile::open(m_path.c_str());
+    if (file == nullptr || file->size() < JOURNAL_HEADER_BYTES ||
+        std::memcmp(file->data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+        readAt<uint32_t>(file->data() + sizeof(JOURNAL_MAGIC)) != JOURNAL_VERSION)
+        return false;
+
+    bool hasMap = false;
+    ImVec2 canvasSize, tileSize;
+    int chunkRows = 0, chunkCols = 0;
+    int selectedLayer = -1;
+    std::vector<NumberedLayer> layers;
+
+    const unsigned char* data = file->data();
+    uint64_t offset = JOURNAL_HEADER_BYTES;
+    while (file->size() - offset >= RECORD_HEADER_BYTES)
+    {
+        const unsigned char* record = data + offset;
+        uint32_t type = readAt<uint32_t>(record);
+        uint32_t size = readAt<uint32_t>(record + 4);
+        if (!isValidRecord(type, size) || file->size() - offset - RECORD_HEADER_BYTES < size)
+            break;
+        const unsigned char* payload = record + RECORD_HEADER_BYTES;
+
+        if (type == RECORD_RESET)
+        {
+            canvasSize = ImVec2(readAt<float>(payload), readAt<float>(payload + 4));
+            tileSize = ImVec2(readAt<float>(payload + 8), readAt<float>(payload + 12));
+            if (!Grid::isValidSize(canvasSize, tileSize))
+                break;
+            chunkRows = Grid::canvasChunks(canvasSize.y, tileSize.y);
+            chunkCols = Grid::canvasChunks(canvasSize.x, tileSize.x);
+            hasMap = true;
+            layers.clear();
+        }
+        else if (type == RECORD_LAYERS)
+        {
+            //A table the grid would refuse ends the replay
+            std::vector<int> numbers;
+            for (uint32_t entry = sizeof(int32_t); entry < size; entry += 2 * sizeof(int32_t))
+                numbers.push_back(readAt<int32_t>(payload + entry));
+            std::sort(numbers.begin(), numbers.end());
+            if (!numbers.empty() && (numbers.front() < 1 || numbers.back() > Grid::MAX_LAYER_NUMBER ||
+                std::adjacent_find(numbers.begin(), numbers.end()) != numbers.end()))
+                break;
+
+            selectedLayer = readAt<int32_t>(payload);
+            std::vector<NumberedLayer> table;
+            for (uint32_t entry = sizeof(int32_t); entry < size; entry += 2 * sizeof(int32_t))
+            {
+                int number = readAt<int32_t>(payload + entry);
+                bool visible = readAt<uint32_t>(payload + entry + 4) != 0;
+                auto existing = std::find_if(layers.begin(), layers.end(), [&](const NumberedLayer& layer) { return layer.number == number; });
+                table.push_back({ number, existing != layers.end() ? std::move(existing->layer) : TileLayer() });
+                table.back().layer.setVisibility(visible);
+            }
+            layers = std::move(table);
+        }
+        else
+        {
+            int layer = readAt<int32_t>(payload);
+            int chunkRow = readAt<int32_t>(payload + 4);
+            int chunkCol = readAt<int32_t>(payload + 8);
+            //A chunk outside the canvas of the last reset ends the replay, before writeChunk grows
+            //the layer's chunk directory to reach it
+            if (chunkRow < 0 || chunkCol < 0 || chunkRow >= chunkRows || chunkCol >= chunkCols)
+                break;
+            auto it = std::find_if(layers.begin(), layers.end(), [&](const NumberedLayer& entry) { return entry.number == layer; });
+            if (it != layers.end())
+                it->layer.writeChunk(chunkRow, chunkCol, size == CHUNK_KEY_BYTES ? nullptr : reinterpret_cast<const ImU32*>(payload + CHUNK_KEY_BYTES));
+        }
+
+        indexRecord(record, offset);
+        offset += RECORD_HEADER_BYTES + size;
+    }
+
+    if (!hasMap)
+    {
+        m_chunkOffsets.clear();
+        m_resetRecord.clear();
+        m_layersRecord.clear();
+        return false;
+    }
+
+    for (NumberedLayer& layer : layers)
+        layer.layer.clearUnsaved();
+    Grid recovered(canvasSize, tileSize);
+    recovered.setLayers(std::move(layers), selectedLayer);
+    recovered.setChunkBudget(grid.getChunkBudget());
+    grid = std::move(recovered);
+    //Remembers the recovered layer table, the journal already holds it
+    appendLayers(grid);
+    m_pending.clear();
+
+    //Rewriting the journal also drops a record torn by the crash
+    m_fileBytes = offset;
+    m_compactOnStart = true;
+    m_journalBytes.store(m_fileBytes, std::memory_order_relaxed);
+    startWriter();
+    return true;
+}
+
+void Autosave::restart(Grid& grid)
+{
+    TILE_TRACE_SCOPE("Autosave::restart");
+    m_pending.clear();
+    append(m_pending, RECORD_RESET);
+    append(m_pending, RESET_BYTES);
+    append(m_pending, grid.getCanvasSize().x);
+    append(m_pending, grid.getCanvasSize().y);
+    append(m_pending, grid.getTileSize().x);
+    append(m_pending, grid.getTileSize().y);
+    appendLayers(grid);
+
+    for (const NumberedLayer& layer : grid.getLayers())
+        grid.findLayer(layer.number)->markAllUnsaved();
+    m_collecting = false;
+    m_lastCycle = std::chrono::steady_clock::time_point();
+    queuePending();
+    startWriter();
+}
+
+bool Autosave::layerTableChanged(const Grid& grid)
+{
+    const auto& layers = grid.getLayers();
+    if (grid.getSelectedLayer() != m_selectedLayer || layers.size() != m_layerTable.size())
+        return true;
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        if (layers[i].number != m_layerTable[i].number || layers[i].layer.getVisibility() != m_layerTable[i].visible)
+            return true;
+    }
+    return false;
+}
+
+void Autosave::appendLayers(const Grid& grid)
+{
+    m_layerTable.clear();
+    for (const NumberedLayer& layer : grid.getLayers())
+        m_layerTable.push_back({ layer.number, layer.layer.getVisibility() });
+    m_selectedLayer = grid.getSelectedLayer();
+
+    append(m_pending, RECORD_LAYERS);
+    append(m_pending, static_cast<uint32_t>(sizeof(int32_t) + 2 * sizeof(int32_t) * m_layerTable.size()));
+    append(m_pending, static_cast<int32_t>(m_selectedLayer));
+    for (const LayerEntry& entry : m_layerTable)
+    {
+        append(m_pending, static_cast<int32_t>(entry.number));
+        append(m_pending, static_cast<uint32_t>(entry.visible ? 1 : 0));
+    }
+}
+
+void Autosave::queuePending()
+{
+    if (m_pending.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(m_pending));
+    }
+    m_wake.notify_one();
+    m_pending = std::vector<unsigned char>();
+}
+
+void Autosave::update(Grid& grid)
+{
+    if (!m_enabled)
+        return;
+    TILE_TRACE_SCOPE("Autosave::update");
+    const auto start = std::chrono::steady_clock::now();
+
+    if (layerTableChanged(grid))
+        appendLayers(grid);
+
+    if (!m_collecting)
+    {
+        if (start - m_lastCycle < m_interval)
+            return;
+        m_collecting = true;
+        m_collectCursor = 0;
+        m_collectLayers.clear();
+        for (const NumberedLayer& layer : grid.getLayers())
+            m_collectLayers.push_back(layer.number);
+    }
+
+    while (m_collectCursor < m_collectLayers.size())
+    {
+        int number = m_collectLayers[m_collectCursor];
+        TileLayer* layer = grid.findLayer(number);
+        if (layer == nullptr || !layer->hasUnsaved())
+        {
+            ++m_collectCursor;
+            continue;
+        }
+
+        layer->takeUnsaved(COLLECT_STEP, [&](int chunkRow, int chunkCol, const ImU32* cells) {
+            appendChunk(m_pending, number, chunkRow, chunkCol, cells);
+        });
+        if (m_pending.size() >= BATCH_BYTES)
+            queuePending();
+        if (std::chrono::steady_clock::now() - start >= COLLECT_BUDGET)
+            return;
+    }
+
+    m_collecting = false;
+    m_lastCycle = start;
+    queuePending();
+}
+
+void Autosave::flush(Grid& grid)
+{
+    TILE_TRACE_SCOPE("Autosave::flush");
+    if (layerTableChanged(grid))
+        appendLayers(grid);
+    for (const NumberedLayer& layer : grid.getLayers())
+    {
+        int number = layer.number;
+        grid.findLayer(number)->takeUnsaved(SIZE_MAX, [&](int chunkRow, int chunkCol, const ImU32* cells) {
+            appendChunk(m_pending, number, chunkRow, chunkCol, cells);
+        });
+    }
+    m_collecting = false;
+    m_lastCycle = std::chrono::steady_clock::now();
+    queuePending();
+}
+
+void Autosave::stopWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    if (m_writer.joinable())
+        m_writer.join();
+}
+
+void Autosave::startWriter()
+{
+    if (!m_writer.joinable())
+        m_writer = std::thread(&Autosave::writerLoop, this);
+}
+
+void Autosave::writerLoop()
+{
+    if (m_compactOnStart && !compact())
+        m_writeFailed.store(true, std::memory_order_relaxed);
+
+    std::vector<std::vector<unsigned char>> batches;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+                break;
+            batches.swap(m_queue);
+        }
+
+        for (const std::vector<unsigned char>& batch : batches)
+            writeBatch(batch);
+        batches.clear();
+        if (m_file != nullptr && std::fflush(m_file) != 0)
+            m_writeFailed.store(true, std::memory_order_relaxed);
+
+        uint64_t liveBytes = JOURNAL_HEADER_BYTES + m_resetRecord.size() + m_layersRecord.size() + m_chunkOffsets.size() * CHUNK_RECORD_BYTES;
+        if (m_fileBytes > COMPACT_MIN_BYTES && m_fileBytes > 2 * liveBytes && !compact())
+            m_writeFailed.store(true, std::memory_order_relaxed);
+        m_journalBytes.store(m_fileBytes, std::memory_order_relaxed);
+    }
+
+    if (m_file != nullptr)
+    {
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+bool Autosave::openJournal(bool truncate)
+{
+    if (m_file != nullptr)
+        std::fclose(m_file);
+    m_file = std::fopen(m_path.c_str(), truncate ? "w+b" : "r+b");
+    if (m_file == nullptr)
+        return false;
+    if (truncate)
+    {
+        m_fileBytes = JOURNAL_HEADER_BYTES;
+        return writeHeader(m_file);
+    }
+    return seek(m_file, m_fileBytes);
+}
+
+void Autosave::writeBatch(const std::vector<unsigned char>& batch)
+{
+    TILE_TRACE_SCOPE_ARG("Autosave::writeBatch", "bytes", static_cast<long long>(batch.size()));
+    size_t position = 0;
+    while (position < batch.size())
+    {
+        const unsigned char* record = batch.data() + position;
+        size_t length = RECORD_HEADER_BYTES + readAt<uint32_t>(record + 4);
+        position += length;
+
+        //A reset supersedes everything before it
+        if (readAt<uint32_t>(record) == RECORD_RESET && !openJournal(true))
+        {
+            m_writeFailed.store(true, std::memory_order_relaxed);
+            continue;
+        }
+        if (m_file == nullptr || std::fwrite(record, 1, length, m_file) != length)
+        {
+            m_writeFailed.store(true, std::memory_order_relaxed);
+            continue;
+        }
+        indexRecord(record, m_fileBytes);
+        m_fileBytes += length;
+    }
+}
+
+void Autosave::indexRecord(const unsigned char* record, uint64_t offset)
+{
+    uint32_t type = readAt<uint32_t>(record);
+    uint32_t size = readAt<uint32_t>(record + 4);
+    const unsigned char* payload = record + RECORD_HEADER_BYTES;
+    if (type == RECORD_RESET)
+    {
+        m_resetRecord.assign(record, payload + size);
+        m_layersRecord.clear();
+        m_chunkOffsets.clear();
+    }
+    else if (type == RECORD_LAYERS)
+    {
+        m_layersRecord.assign(record, payload + size);
+        std::vector<int> numbers;
+        for (uint32_t entry = sizeof(int32_t); entry < size; entry += 2 * sizeof(int32_t))
+            numbers.push_back(readAt<int32_t>(payload + entry));
+        for (auto it = m_chunkOffsets.begin(); it != m_chunkOffsets.end();)
+        {
+            if (std::find(numbers.begin(), numbers.end(), std::get<0>(it->first)) == numbers.end())
+                it = m_chunkOffsets.erase(it);
+            else
+                ++it;
+        }
+    }
+    else
+    {
+        ChunkKey key(readAt<int32_t>(payload), readAt<int32_t>(payload + 4), readAt<int32_t>(payload + 8));
+        //Empty chunks need no record once the journal is compacted
+        if (size == CHUNK_KEY_BYTES)
+            m_chunkOffsets.erase(key);
+        else
+            m_chunkOffsets[key] = offset;
+    }
+}
+
+bool Autosave::compact()
+{
+    TILE_TRACE_SCOPE("Autosave::compact");
+    std::string compactPath = m_path + ".tmp";
+    FILE* source = m_file != nullptr ? m_file : std::fopen(m_path.c_str(), "rb");
+    FILE* compacted = std::fopen(compactPath.c_str(), "wb");
+    bool written = source != nullptr && compacted != nullptr && writeHeader(compacted);
+    if (written && !m_resetRecord.empty())
+        written = std::fwrite(m_resetRecord.data(), 1, m_resetRecord.size(), compacted) == m_resetRecord.size();
+    if (written && !m_layersRecord.empty())
+        written = std::fwrite(m_layersRecord.data(), 1, m_layersRecord.size(), compacted) == m_layersRecord.size();
+
+    uint64_t offset = JOURNAL_HEADER_BYTES + m_resetRecord.size() + m_layersRecord.size();
+    std::vector<unsigned char> record(CHUNK_RECORD_BYTES);
+    std::map<ChunkKey, uint64_t> offsets;
+    for (auto it = m_chunkOffsets.begin(); written && it != m_chunkOffsets.end(); ++it)
+    {
+        written = seek(source, it->second) && std::fread(record.data(), 1, record.size(), source) == record.size() &&
+            std::fwrite(record.data(), 1, record.size(), compacted) == record.size();
+        offsets.emplace_hint(offsets.end(), it->first, offset);
+        offset += CHUNK_RECORD_BYTES;
+    }
+
+    if (source != nullptr)
+        std::fclose(source);
+    m_file = nullptr;
+    if (compacted != nullptr)
+        written = std::fclose(compacted) == 0 && written;
+    if (!written || !replaceFile(compactPath.c_str(), m_path.c_str()))
+    {
+        std::remove(compactPath.c_str());
+        //The journal is left as it was, appending resumes at its end
+        openJournal(false);
+        return false;
+    }
+
+    m_chunkOffsets = std::move(offsets);
+    m_fileBytes = offset;
+    m_journalBytes.store(m_fileBytes, std::memory_order_relaxed);
+    return openJournal(false);
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <imgui.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+class Grid;
+
+//Session autosave: an append-only journal of the chunks changed since the previous save,
+//written by a background thread so the editor never waits for the disk.
+//
+//  "TILEJRN\0", uint32 version, uint32 reserved
+//  records: uint32 type, uint32 payload size, payload
+//    reset   float canvasWidth, canvasHeight, tileWidth, tileHeight; drops every layer
+//    layers  int32 selectedLayer, { int32 number, uint32 visible }[] bottom first; adds, removes and orders layers
+//    chunk   int32 layer, chunkRow, chunkCol, TILE_CHUNK_CELLS ImU32; no cells for an empty chunk
+//
+//Replaying the records in order rebuilds the map. A record cut short by a crash ends the replay, as
+//does a corrupt one: a map Grid::isValidSize refuses or a chunk outside the canvas of the last reset.
+//Once the journal is mostly superseded records it is compacted to the latest record of every chunk.
+//
+//update collects unsaved chunks on the main thread for at most COLLECT_BUDGET per frame, then
+//queues them for the writer; the main thread only ever holds the queue lock for a vector move.
+class Autosave
+{
+public:
+    static constexpr std::chrono::microseconds COLLECT_BUDGET{ 500 };
+
+private:
+    struct LayerEntry
+    {
+        int number;
+        bool visible;
+
+        bool operator==(const LayerEntry& other) const
+        {
+            return number == other.number && visible == other.visible;
+        }
+    };
+
+    using ChunkKey = std::tuple<int, int, int>;
+
+    std::string m_path;
+    std::chrono::steady_clock::duration m_interval = std::chrono::seconds(2);
+    bool m_enabled = true;
+
+    //Main thread
+    std::vector<unsigned char> m_pending;
+    std::vector<LayerEntry> m_layerTable;
+    int m_selectedLayer = -1;
+    std::vector<int> m_collectLayers;
+    size_t m_collectCursor = 0;
+    bool m_collecting = false;
+    std::chrono::steady_clock::time_point m_lastCycle = std::chrono::steady_clock::now();
+
+    //Shared with the writer
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::vector<std::vector<unsigned char>> m_queue;
+    bool m_stop = false;
+    std::atomic<uint64_t> m_journalBytes{ 0 };
+    std::atomic<bool> m_writeFailed{ false };
+    std::thread m_writer;
+
+    //Writer thread, or the main thread before the writer starts
+    FILE* m_file = nullptr;
+    uint64_t m_fileBytes = 0;
+    std::vector<unsigned char> m_resetRecord;
+    std::vector<unsigned char> m_layersRecord;
+    std::map<ChunkKey, uint64_t> m_chunkOffsets;
+    bool m_compactOnStart = false;
+
+    void startWriter();
+    void stopWriter();
+    void writerLoop();
+    void queuePending();
+    void appendLayers(const Grid& grid);
+    bool layerTableChanged(const Grid& grid);
+
+    bool openJournal(bool truncate);
+    void writeBatch(const std::vector<unsigned char>& batch);
+    void indexRecord(const unsigned char* record, uint64_t offset);
+    bool compact();
+
+public:
+    explicit Autosave(std::string journalPath);
+    ~Autosave();
+
+    Autosave(const Autosave&) = delete;
+    Autosave& operator=(const Autosave&) = delete;
+
+    //Replays the journal into grid, keeping its chunk budget. Returns false and leaves grid
+    //untouched if there is no journal or it holds no map. Call before restart or update.
+    bool recover(Grid& grid);
+
+    //Starts the journal over from the current state of grid, e.g. after a project was opened.
+    //Every chunk is written again over the following cycles.
+    void restart(Grid& grid);
+
+    //Call once per frame. Records layer changes and, every interval, the chunks changed since
+    //the previous cycle.
+    void update(Grid& grid);
+
+    //Collects and queues every unsaved chunk without a time budget
+    void flush(Grid& grid);
+
+    //Call last, on a clean exit: waits for the writer and removes the journal, so only a journal
+    //left behind by a crash is replayed by the next recover
+    void close();
+
+    void setEnabled(bool enabled)
+    {
+        m_enabled = enabled;
+    }
+
+    bool isEnabled() const
+    {
+        return m_enabled;
+    }
+
+    void setInterval(std::chrono::steady_clock::duration interval)
+    {
+        m_interval = interval;
+    }
+
+    uint64_t getJournalBytes() const
+    {
+        return m_journalBytes.load(std::memory_order_relaxed);
+    }
+
+    bool hasWriteFailed() const
+    {
+        return m_writeFailed.load(std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,38 @@
+#include "Brush.h"
+#include "Shape.h"
+#include <algorithm>
+
+Brush::Brush(BrushShape shape, int size) :
+    m_shape(shape == BrushShape::Circle ? BrushShape::Circle : BrushShape::Square),
+    m_size(std::min(std::max(size, 1), MAX_SIZE))
+{
+    const int offset = -(m_size / 2);
+    rasterizeShape(m_shape == BrushShape::Circle ? ShapeKind::FilledEllipse : ShapeKind::FilledRectangle,
+        offset, offset, offset + m_size - 1, offset + m_size - 1, m_spans);
+}
+
+Brush::Brush(const TileBuffer& cells) : m_shape(BrushShape::Custom), m_size(1)
+{
+    const int rows = std::min(cells.rows, MAX_SIZE);
+    const int cols = std::min(cells.cols, MAX_SIZE);
+    for (int row = 0; row < rows; ++row)
+    {
+        const ImU32* cell = cells.row(row);
+        int col = 0;
+        while (col < cols)
+        {
+            while (col < cols && cell[col] == IM_COL32_BLACK_TRANS)
+                ++col;
+            int first = col;
+            while (col < cols && cell[col] != IM_COL32_BLACK_TRANS)
+                ++col;
+            if (first < col)
+                m_spans.push_back({ row - rows / 2, first - cols / 2, col - cols / 2 });
+        }
+    }
+
+    if (m_spans.empty())
+        m_spans.push_back({ 0, 0, 1 });
+    else
+        m_size = std::max(rows, cols);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "TileLayer.h"
+#include <vector>
+
+enum class BrushShape
+{
+    Square,
+    Circle,
+    Custom,
+};
+
+//Pen stamp, precomputed once into row spans of pen cells relative to the pen cell under the
+//cursor, which is the middle of the brush. Stamping it is a row fill per span, so a 256 cell
+//brush costs a few hundred span writes instead of 65536 cell writes.
+class Brush
+{
+private:
+    BrushShape m_shape;
+    int m_size;
+    std::vector<TileSpan> m_spans;
+
+public:
+    static constexpr int MAX_SIZE = 256;
+
+    //Square or circle brush size pen cells across, clamped to [1, MAX_SIZE]
+    Brush(BrushShape shape = BrushShape::Square, int size = 1);
+
+    //Custom brush of the painted cells of buffer, e.g. a copied selection, clipped to MAX_SIZE
+    //cells across. A buffer with no painted cell gives a one cell brush.
+    explicit Brush(const TileBuffer& cells);
+
+    BrushShape getShape() const
+    {
+        return m_shape;
+    }
+
+    //Cells across the larger side
+    int getSize() const
+    {
+        return m_size;
+    }
+
+    //Rows in increasing order, the spans of a row do not overlap
+    const std::vector<TileSpan>& getSpans() const
+    {
+        return m_spans;
+    }
+};
@@ -0,0 +1,65 @@
+#include "ChunkStore.h"
+#include "TileLayer.h"
+
+namespace
+{
+    constexpr int64_t SLOT_BYTES = sizeof(ImU32) * TILE_CHUNK_CELLS;
+
+    //The store outgrows the 2 GiB a long offset reaches on Windows
+    bool seek(FILE* file, int32_t slot)
+    {
+#if defined(_MSC_VER)
+        return _fseeki64(file, slot * SLOT_BYTES, SEEK_SET) == 0;
+#else
+        return fseeko(file, static_cast<off_t>(slot * SLOT_BYTES), SEEK_SET) == 0;
+#endif
+    }
+}
+
+ChunkStore::~ChunkStore()
+{
+    if (m_file != nullptr)
+        std::fclose(m_file);
+}
+
+int32_t ChunkStore::write(int32_t slot, const ImU32* cells)
+{
+    if (m_file == nullptr)
+    {
+        m_file = std::tmpfile();
+        if (m_file == nullptr)
+            return -1;
+    }
+
+    bool isNew = slot < 0;
+    if (isNew)
+    {
+        if (!m_freeSlots.empty())
+        {
+            slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        }
+        else
+        {
+            slot = m_slotCount++;
+        }
+    }
+
+    if (!seek(m_file, slot) || std::fwrite(cells, sizeof(ImU32), TILE_CHUNK_CELLS, m_file) != TILE_CHUNK_CELLS)
+    {
+        if (isNew)
+            m_freeSlots.push_back(slot);
+        return -1;
+    }
+    return slot;
+}
+
+bool ChunkStore::read(int32_t slot, ImU32* cells) const
+{
+    return m_file != nullptr && seek(m_file, slot) && std::fread(cells, sizeof(ImU32), TILE_CHUNK_CELLS, m_file) == TILE_CHUNK_CELLS;
+}
+
+void ChunkStore::release(int32_t slot)
+{
+    m_freeSlots.push_back(slot);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <imgui.h>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+//Scratch file holding the cells of chunks evicted from memory, one fixed-size slot per chunk.
+//The file is anonymous and removed when the store is destroyed; freed slots are reused.
+class ChunkStore
+{
+private:
+    FILE* m_file = nullptr;
+    int32_t m_slotCount = 0;
+    std::vector<int32_t> m_freeSlots;
+
+public:
+    ChunkStore() = default;
+    ~ChunkStore();
+
+    ChunkStore(const ChunkStore&) = delete;
+    ChunkStore& operator=(const ChunkStore&) = delete;
+
+    //Writes TILE_CHUNK_CELLS cells into slot, or into a new slot when slot is -1.
+    //Returns the slot written, or -1 if the file could not be written.
+    int32_t write(int32_t slot, const ImU32* cells);
+
+    bool read(int32_t slot, ImU32* cells) const;
+
+    void release(int32_t slot);
+
+    //Slots in use
+    size_t getSlotCount() const
+    {
+        return static_cast<size_t>(m_slotCount) - m_freeSlots.size();
+    }
+};
@@ -0,0 +1,190 @@
+#include "Compositor.h"
+#include "Trace.h"
+#include <algorithm>
+#include <utility>
+
+static_assert(IM_COL32_A_SHIFT == 24, "The blend kernels expect alpha in the high byte of a pixel");
+
+namespace
+{
+    //x / 255 rounded to nearest, exact for x in [0, 255 * 255]
+    inline uint32_t div255(uint32_t x)
+    {
+        x += 128;
+        return (x + (x >> 8)) >> 8;
+    }
+
+#if defined(TILE_SSE2)
+    inline __m128i div255(__m128i x)
+    {
+        x = _mm_add_epi16(x, _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    }
+
+    //Two pixels widened to 16 bits per channel. The alpha channel is multiplied by 255 instead of
+    //by itself, which div255 turns back into alpha exactly, so all four channels share one formula.
+    inline __m128i blendOverWide(__m128i src, __m128i dst)
+    {
+        const __m128i full = _mm_set1_epi16(255);
+        const __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+        __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        __m128i factor = _mm_or_si128(_mm_andnot_si128(alphaLanes, alpha), _mm_and_si128(alphaLanes, full));
+        __m128i inverse = _mm_sub_epi16(full, alpha);
+        return _mm_add_epi16(div255(_mm_mullo_epi16(src, factor)), div255(_mm_mullo_epi16(dst, inverse)));
+    }
+#endif
+
+#if defined(TILE_AVX2)
+    inline __m256i div255(__m256i x)
+    {
+        x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+        return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+    }
+
+    inline __m256i blendOverWide(__m256i src, __m256i dst)
+    {
+        const __m256i full = _mm256_set1_epi16(255);
+        const __m256i alphaLanes = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+        __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        __m256i factor = _mm256_or_si256(_mm256_andnot_si256(alphaLanes, alpha), _mm256_and_si256(alphaLanes, full));
+        __m256i inverse = _mm256_sub_epi16(full, alpha);
+        return _mm256_add_epi16(div255(_mm256_mullo_epi16(src, factor)), div255(_mm256_mullo_epi16(dst, inverse)));
+    }
+#endif
+}
+
+void blendOverScalar(uint32_t* dst, const ImU32* src, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        const uint32_t source = src[i];
+        const uint32_t alpha = source >> IM_COL32_A_SHIFT;
+        const uint32_t inverse = 255 - alpha;
+        uint32_t blended = 0;
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            uint32_t factor = shift == IM_COL32_A_SHIFT ? 255 : alpha;
+            uint32_t channel = div255(((source >> shift) & 0xFF) * factor) + div255(((dst[i] >> shift) & 0xFF) * inverse);
+            blended |= channel << shift;
+        }
+        dst[i] = blended;
+    }
+}
+
+#if defined(TILE_SSE2)
+void blendOverSse2(uint32_t* dst, const ImU32* src, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i target = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i low = blendOverWide(_mm_unpacklo_epi8(source, zero), _mm_unpacklo_epi8(target, zero));
+        __m128i high = blendOverWide(_mm_unpackhi_epi8(source, zero), _mm_unpackhi_epi8(target, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(low, high));
+    }
+    blendOverScalar(dst + i, src + i, count - i);
+}
+#endif
+
+#if defined(TILE_AVX2)
+void blendOverAvx2(uint32_t* dst, const ImU32* src, int count)
+{
+    //Unpack and pack both work within 128-bit lanes, so the pixels come back in order
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i source = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i target = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i low = blendOverWide(_mm256_unpacklo_epi8(source, zero), _mm256_unpacklo_epi8(target, zero));
+        __m256i high = blendOverWide(_mm256_unpackhi_epi8(source, zero), _mm256_unpackhi_epi8(target, zero));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(low, high));
+    }
+    blendOverScalar(dst + i, src + i, count - i);
+}
+#endif
+
+void blendOverRow(uint32_t* dst, const ImU32* src, int count)
+{
+#if defined(TILE_AVX2)
+    blendOverAvx2(dst, src, count);
+#elif defined(TILE_SSE2)
+    blendOverSse2(dst, src, count);
+#else
+    blendOverScalar(dst, src, count);
+#endif
+}
+
+void unpremultiply(uint32_t* pixels, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        const uint32_t pixel = pixels[i];
+        const uint32_t alpha = pixel >> IM_COL32_A_SHIFT;
+        if (alpha == 255 || alpha == 0)
+            continue;
+
+        uint32_t straight = alpha << IM_COL32_A_SHIFT;
+        for (int shift = 0; shift < IM_COL32_A_SHIFT; shift += 8)
+            straight |= std::min<uint32_t>(255, (((pixel >> shift) & 0xFF) * 255 + alpha / 2) / alpha) << shift;
+        pixels[i] = straight;
+    }
+}
+
+const CompositeChunk& LayerCompositor::composite(const std::vector<const TileLayer*>& layers, int chunkRow, int chunkCol)
+{
+    m_sources.clear();
+    bool changed = false;
+    for (const TileLayer* layer : layers)
+    {
+        const TileChunk* chunk = layer->findChunk(chunkRow, chunkCol);
+        if (chunk == nullptr || chunk->occupiedCount == 0)
+            continue;
+        m_sources.push_back(chunk);
+        changed |= chunk->compositeDirty;
+    }
+
+    uint64_t key = static_cast<uint64_t>(static_cast<uint32_t>(chunkRow)) << 32 | static_cast<uint32_t>(chunkCol);
+    CompositeChunk& entry = m_chunks[key];
+    entry.lastUse = m_frame;
+    if (!changed && entry.revision != 0 && entry.sources == m_sources)
+        return entry;
+
+    TILE_TRACE_SCOPE("LayerCompositor::composite");
+    entry.pixels.fill(IM_COL32_BLACK_TRANS);
+    for (const TileChunk* chunk : m_sources)
+    {
+        //Empty cells leave the pixels below as they are, so rows without painted cells are skipped
+        for (int row = 0; row < TILE_CHUNK_SIZE; ++row)
+        {
+            if (chunk->occupancy[row] != 0)
+                blendOverRow(&entry.pixels[row * TILE_CHUNK_SIZE], &chunk->cells[row * TILE_CHUNK_SIZE], TILE_CHUNK_SIZE);
+        }
+        chunk->compositeDirty = false;
+    }
+    unpremultiply(entry.pixels.data(), TILE_CHUNK_CELLS);
+
+    entry.empty = m_sources.empty();
+    entry.sources = m_sources;
+    entry.revision = m_nextRevision++;
+    ++m_composites;
+    return entry;
+}
+
+void LayerCompositor::trim(size_t maxChunks)
+{
+    if (m_chunks.size() <= maxChunks)
+        return;
+
+    std::vector<std::pair<uint32_t, uint64_t>> unused;
+    for (const auto& chunk : m_chunks)
+    {
+        if (chunk.second.lastUse != m_frame)
+            unused.push_back({ chunk.second.lastUse, chunk.first });
+    }
+    std::sort(unused.begin(), unused.end());
+    for (size_t i = 0; i < unused.size() && m_chunks.size() > maxChunks; ++i)
+        m_chunks.erase(unused[i].second);
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include "TileLayer.h"
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#if defined(__AVX2__) && !defined(TILE_AVX2)
+#define TILE_AVX2 1
+#endif
+#if defined(TILE_AVX2)
+#include <immintrin.h>
+#endif
+
+//Blends count straight alpha RGBA8 pixels of src over the premultiplied RGBA8 pixels of dst:
+//dst = src * srcAlpha + dst * (1 - srcAlpha), each product rounded to the nearest multiple of 1/255.
+//The SIMD variants are integer exact and give the same bits as the scalar one; blendOverRow uses the
+//widest one compiled in (AVX2 needs the TILE_AVX2 build option).
+void blendOverScalar(uint32_t* dst, const ImU32* src, int count);
+#if defined(TILE_SSE2)
+void blendOverSse2(uint32_t* dst, const ImU32* src, int count);
+#endif
+#if defined(TILE_AVX2)
+void blendOverAvx2(uint32_t* dst, const ImU32* src, int count);
+#endif
+void blendOverRow(uint32_t* dst, const ImU32* src, int count);
+
+//Turns premultiplied pixels back into straight alpha, which is what the renderer blends with
+void unpremultiply(uint32_t* pixels, int count);
+
+//Visible layers of one chunk flattened into RGBA8 pixels, one pixel per tile in IM_COL32 layout
+struct CompositeChunk
+{
+    std::array<uint32_t, TILE_CHUNK_CELLS> pixels{};
+    //Changes on every recomposite and is never reused by the same compositor, texture caches upload
+    //again when it differs
+    uint64_t revision = 0;
+    //No layer has a painted cell in the chunk
+    bool empty = true;
+    //Chunks of the layers blended, bottom first, with painted cells only
+    std::vector<const TileChunk*> sources;
+    uint32_t lastUse = 0;
+};
+
+//Flattens the visible layers chunk by chunk, so the renderer draws one textured quad per chunk
+//whatever the number of layers, instead of every layer's quads on top of each other.
+//Composites are cached and blended again only when the chunks of the layers at that position,
+//their order, or any of their cells (TileChunk::compositeDirty) changed.
+class LayerCompositor
+{
+private:
+    std::unordered_map<uint64_t, CompositeChunk> m_chunks;
+    uint32_t m_frame = 1;
+    uint64_t m_nextRevision = 1;
+    size_t m_composites = 0;
+    std::vector<const TileChunk*> m_sources;
+
+public:
+    //layers are the visible layers, bottom first
+    const CompositeChunk& composite(const std::vector<const TileLayer*>& layers, int chunkRow, int chunkCol);
+
+    //Composites not used since the last beginFrame are dropped, oldest first, down to maxChunks
+    void beginFrame()
+    {
+        ++m_frame;
+    }
+    void trim(size_t maxChunks);
+
+    void clear()
+    {
+        m_chunks.clear();
+    }
+
+    size_t getCachedChunkCount() const
+    {
+        return m_chunks.size();
+    }
+
+    //Number of chunks blended since the compositor was created
+    size_t getCompositeCount() const
+    {
+        return m_composites;
+    }
+};
+
+//Texture per composited chunk, implemented on the renderer backend (see the editor's ChunkTextures)
+class CompositeTextures
+{
+public:
+    virtual ~CompositeTextures() = default;
+
+    //Texture of TILE_CHUNK_SIZE x TILE_CHUNK_SIZE pixels holding chunk.pixels, uploaded again when
+    //chunk.revision changed since the last call for the same chunk
+    virtual ImTextureID getTexture(int chunkRow, int chunkCol, const CompositeChunk& chunk) = 0;
+};
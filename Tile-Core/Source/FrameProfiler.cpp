@@ -0,0 +1,163 @@
+#include "FrameProfiler.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+const char* FrameProfiler::getPhaseName(FramePhase phase)
+{
+    switch (phase)
+    {
+    case FramePhase::Events: return "Events";
+    case FramePhase::Update: return "SFML Update";
+    case FramePhase::GridRender: return "Grid Render";
+    case FramePhase::LayerWindow: return "Layer Window";
+    case FramePhase::EditPanel: return "Edit Panel";
+    case FramePhase::Render: return "SFML Render";
+    case FramePhase::Display: return "Display";
+    default: return "Other";
+    }
+}
+
+ImU32 FrameProfiler::getPhaseColor(FramePhase phase)
+{
+    switch (phase)
+    {
+    case FramePhase::Events: return IM_COL32(230, 159, 0, 255);
+    case FramePhase::Update: return IM_COL32(86, 180, 233, 255);
+    case FramePhase::GridRender: return IM_COL32(213, 94, 0, 255);
+    case FramePhase::LayerWindow: return IM_COL32(0, 158, 115, 255);
+    case FramePhase::EditPanel: return IM_COL32(240, 228, 66, 255);
+    case FramePhase::Render: return IM_COL32(0, 114, 178, 255);
+    case FramePhase::Display: return IM_COL32(204, 121, 167, 255);
+    default: return IM_COL32(128, 128, 128, 255);
+    }
+}
+
+void FrameProfiler::beginFrame()
+{
+    m_current = FrameSample();
+    m_phase = FramePhase::Count;
+    m_frameStart = std::chrono::steady_clock::now();
+    m_inFrame = true;
+}
+
+void FrameProfiler::endFrame()
+{
+    if (!m_inFrame)
+        return;
+
+    endPhase();
+    m_current.total = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_frameStart).count();
+    m_history[m_nextSample] = m_current;
+    m_nextSample = (m_nextSample + 1) % FRAME_HISTORY;
+    m_sampleCount = std::min(m_sampleCount + 1, FRAME_HISTORY);
+    m_inFrame = false;
+}
+
+float FrameProfiler::sampleValue(const FrameSample& sample, int phase) const
+{
+    if (phase < 0)
+        return sample.total;
+    if (phase < FRAME_PHASE_COUNT)
+        return sample.phases[phase];
+
+    float covered = 0.0f;
+    for (float time : sample.phases)
+        covered += time;
+    return std::max(0.0f, sample.total - covered);
+}
+
+FrameProfiler::Stats FrameProfiler::computeStats(int phase)
+{
+    m_sorted.clear();
+    for (int i = 0; i < m_sampleCount; ++i)
+        m_sorted.push_back(sampleValue(m_history[i], phase));
+    if (m_sorted.empty())
+        return { 0.0f, 0.0f, 0.0f };
+
+    std::sort(m_sorted.begin(), m_sorted.end());
+    float sum = 0.0f;
+    for (float time : m_sorted)
+        sum += time;
+    size_t p99 = static_cast<size_t>(std::ceil(0.99 * m_sorted.size())) - 1;
+    return { m_sorted.front(), sum / m_sorted.size(), m_sorted[p99] };
+}
+
+void FrameProfiler::drawWindow(bool* open)
+{
+    ImGui::Begin("Profiler", open);
+
+    ImGui::Text(("Frames : " + std::to_string(m_sampleCount)).c_str());
+    if (ImGui::BeginTable("Phases", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+    {
+        ImGui::TableSetupColumn("Phase");
+        ImGui::TableSetupColumn("Min ms");
+        ImGui::TableSetupColumn("Avg ms");
+        ImGui::TableSetupColumn("P99 ms");
+        ImGui::TableHeadersRow();
+
+        //Phases, then the uncovered time, then the whole frame
+        for (int phase = 0; phase <= FRAME_PHASE_COUNT + 1; ++phase)
+        {
+            int statPhase = phase <= FRAME_PHASE_COUNT ? phase : -1;
+            Stats stats = computeStats(statPhase);
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            if (statPhase < 0)
+            {
+                ImGui::Text("Frame");
+            }
+            else
+            {
+                ImGui::ColorButton(("##" + std::to_string(phase)).c_str(), ImGui::ColorConvertU32ToFloat4(getPhaseColor(static_cast<FramePhase>(phase))),
+                    ImGuiColorEditFlags_NoTooltip, ImVec2(ImGui::GetTextLineHeight(), ImGui::GetTextLineHeight()));
+                ImGui::SameLine();
+                ImGui::Text(getPhaseName(static_cast<FramePhase>(phase)));
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats.min);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats.avg);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats.p99);
+        }
+        ImGui::EndTable();
+    }
+
+    //History graph: one column per frame, oldest on the left, phases stacked bottom to top in frame order.
+    //The vertical scale follows the slowest recorded frame.
+    float scale = 0.0f;
+    for (int i = 0; i < m_sampleCount; ++i)
+        scale = std::max(scale, m_history[i].total);
+    ImGui::Text("History (top = %.2f ms)", scale);
+
+    ImVec2 graphSize(std::max(ImGui::GetContentRegionAvail().x, 200.0f), 120.0f);
+    ImVec2 graphMin = ImGui::GetCursorScreenPos();
+    ImVec2 graphMax(graphMin.x + graphSize.x, graphMin.y + graphSize.y);
+    ImGui::Dummy(graphSize);
+
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    drawList->AddRectFilled(graphMin, graphMax, IM_COL32(20, 20, 20, 255));
+    if (scale > 0.0f)
+    {
+        float columnWidth = graphSize.x / FRAME_HISTORY;
+        int oldest = m_sampleCount < FRAME_HISTORY ? 0 : m_nextSample;
+        for (int i = 0; i < m_sampleCount; ++i)
+        {
+            const FrameSample& sample = m_history[(oldest + i) % FRAME_HISTORY];
+            float left = graphMin.x + (FRAME_HISTORY - m_sampleCount + i) * columnWidth;
+            float bottom = graphMax.y;
+            for (int phase = 0; phase <= FRAME_PHASE_COUNT; ++phase)
+            {
+                float height = sampleValue(sample, phase) / scale * graphSize.y;
+                if (height <= 0.0f)
+                    continue;
+                drawList->AddRectFilled(ImVec2(left, bottom - height), ImVec2(left + std::max(columnWidth, 1.0f), bottom), getPhaseColor(static_cast<FramePhase>(phase)));
+                bottom -= height;
+            }
+        }
+    }
+
+    ImGui::End();
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <imgui.h>
+#include <array>
+#include <chrono>
+#include <vector>
+
+//Parts of an editor frame timed by FrameProfiler, in frame order
+enum class FramePhase
+{
+    Events,
+    Update,
+    GridRender,
+    LayerWindow,
+    EditPanel,
+    Render,
+    Display,
+    Count
+};
+
+constexpr int FRAME_PHASE_COUNT = static_cast<int>(FramePhase::Count);
+
+//Rolling per-frame breakdown of where the editor spends its time.
+//Each frame records the milliseconds spent in every phase plus the whole frame; time not
+//covered by a phase shows up as "Other". The last FRAME_HISTORY frames are kept.
+class FrameProfiler
+{
+public:
+    static constexpr int FRAME_HISTORY = 240;
+
+private:
+    struct FrameSample
+    {
+        std::array<float, FRAME_PHASE_COUNT> phases{};
+        float total = 0.0f;
+    };
+
+    std::array<FrameSample, FRAME_HISTORY> m_history{};
+    FrameSample m_current;
+    std::chrono::steady_clock::time_point m_frameStart;
+    std::chrono::steady_clock::time_point m_phaseStart;
+    FramePhase m_phase = FramePhase::Count;
+    int m_nextSample = 0;
+    int m_sampleCount = 0;
+    bool m_inFrame = false;
+
+    //Scratch buffer for percentiles, kept to avoid an allocation per frame
+    std::vector<float> m_sorted;
+
+public:
+    static const char* getPhaseName(FramePhase phase);
+    static ImU32 getPhaseColor(FramePhase phase);
+
+    void beginFrame();
+    void endFrame();
+
+    //Phases do not nest: beginning a phase ends the running one
+    void beginPhase(FramePhase phase)
+    {
+        endPhase();
+        m_phase = phase;
+        m_phaseStart = std::chrono::steady_clock::now();
+    }
+
+    void endPhase()
+    {
+        if (m_phase == FramePhase::Count)
+            return;
+        m_current.phases[static_cast<int>(m_phase)] += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_phaseStart).count();
+        m_phase = FramePhase::Count;
+    }
+
+    int getSampleCount() const
+    {
+        return m_sampleCount;
+    }
+
+    //Draws the "Profiler" window: min/avg/p99 per phase and a stacked history graph of the recorded frames
+    void drawWindow(bool* open);
+
+private:
+    struct Stats
+    {
+        float min, avg, p99;
+    };
+
+    //Statistics over the recorded frames of one phase, or of the whole frame when phase is -1.
+    //Phase index FRAME_PHASE_COUNT is the time not covered by any phase.
+    Stats computeStats(int phase);
+    float sampleValue(const FrameSample& sample, int phase) const;
+};
@@ -0,0 +1,871 @@
+#include "Grid.h"
+#include "ChunkStore.h"
+#include "MappedFile.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace
+{
+    //Compares chunk rows of a set of layers against their colours at a seed cell,
+    //32 cells at a time into a bitmask
+    class RegionSampler
+    {
+    private:
+        struct Source
+        {
+            const TileLayer* layer;
+            ImU32 target;
+        };
+
+        std::vector<Source> m_sources;
+
+    public:
+        RegionSampler(const std::vector<const TileLayer*>& layers, int row, int col)
+        {
+            for (const TileLayer* layer : layers)
+                m_sources.push_back({ layer, layer->getTile(row, col) });
+        }
+
+        //Bit col of rowMasks[row] is set when cell (row, col) of the chunk matches on every layer
+        void matchChunk(int chunkRow, int chunkCol, uint32_t* rowMasks) const
+        {
+            std::fill(rowMasks, rowMasks + TILE_CHUNK_SIZE, ~0u);
+            for (const Source& source : m_sources)
+            {
+                const TileChunk* chunk = source.layer->findChunk(chunkRow, chunkCol);
+                if (chunk == nullptr)
+                {
+                    if (source.target != IM_COL32_BLACK_TRANS)
+                        std::fill(rowMasks, rowMasks + TILE_CHUNK_SIZE, 0u);
+                    continue;
+                }
+                for (int row = 0; row < TILE_CHUNK_SIZE; ++row)
+                {
+                    //Empty cells are exactly the clear occupancy bits
+                    if (source.target == IM_COL32_BLACK_TRANS)
+                    {
+                        rowMasks[row] &= ~chunk->occupancy[row];
+                        continue;
+                    }
+                    rowMasks[row] &= tileRowMatch(&chunk->cells[row * TILE_CHUNK_SIZE], source.target);
+                }
+            }
+        }
+    };
+}
+
+Grid::Grid(ImVec2 canvasSize, ImVec2 cellSize) : 
+    m_canvasSize(canvasSize), 
+    m_cellSize(cellSize), 
+    m_tileSize(cellSize),
+    m_numRows(static_cast<int>(m_canvasSize.y / m_cellSize.y)),
+    m_numCols(static_cast<int>(m_canvasSize.x / m_cellSize.x))
+{
+    m_tileLayers.push_back({ 1, TileLayer() });
+    m_tileLayers.back().layer.setUseEpoch(m_useEpoch);
+    indexLayers();
+}
+
+Grid::CellRange Grid::visibleCells(const ImDrawList* drawList, ImVec2 origin, ImVec2 cellSize) const
+{
+    ImVec2 clipMin = drawList->GetClipRectMin();
+    ImVec2 clipMax = drawList->GetClipRectMax();
+
+    CellRange range;
+    range.firstRow = std::max(0, static_cast<int>(std::floor((clipMin.y - origin.y) / cellSize.y)));
+    range.firstCol = std::max(0, static_cast<int>(std::floor((clipMin.x - origin.x) / cellSize.x)));
+    range.lastRow = std::min(m_numRows, static_cast<int>(std::ceil((clipMax.y - origin.y) / cellSize.y)));
+    range.lastCol = std::min(m_numCols, static_cast<int>(std::ceil((clipMax.x - origin.x) / cellSize.x)));
+    return range;
+}
+
+int Grid::appendQuads(ImDrawList* drawList, const std::vector<TileQuad>& quads, ImVec2 chunkPos, ImVec2 tileSize)
+{
+    int count = static_cast<int>(quads.size());
+    drawList->PrimReserve(count * 6, count * 4);
+    for (const TileQuad& quad : quads)
+    {
+        ImVec2 min(chunkPos.x + quad.firstCol * tileSize.x, chunkPos.y + quad.firstRow * tileSize.y);
+        ImVec2 max(chunkPos.x + quad.lastCol * tileSize.x, chunkPos.y + quad.lastRow * tileSize.y);
+        drawList->PrimRect(min, max, quad.color);
+    }
+    return count;
+}
+
+int Grid::appendSpans(ImDrawList* drawList, const std::vector<TileSpan>& spans, ImVec2 origin, ImVec2 tileSize, ImU32 color)
+{
+    int count = 0;
+    for (size_t i = 0; i < spans.size();)
+    {
+        size_t last = i + 1;
+        while (last < spans.size() && spans[last].row == spans[last - 1].row + 1 &&
+            spans[last].firstCol == spans[i].firstCol && spans[last].lastCol == spans[i].lastCol)
+            ++last;
+
+        ImVec2 min(origin.x + spans[i].firstCol * tileSize.x, origin.y + spans[i].row * tileSize.y);
+        ImVec2 max(origin.x + spans[i].lastCol * tileSize.x, origin.y + (spans[last - 1].row + 1) * tileSize.y);
+        drawList->AddRectFilled(min, max, color);
+        ++count;
+        i = last;
+    }
+    return count;
+}
+
+int Grid::appendLayer(ImDrawList* drawList, const TileLayer& layer, ImVec2 origin, const CellRange& range)
+{
+    int count = 0;
+    for (int chunkRow = range.firstRow / TILE_CHUNK_SIZE; chunkRow <= (range.lastRow - 1) / TILE_CHUNK_SIZE; ++chunkRow)
+    {
+        for (int chunkCol = range.firstCol / TILE_CHUNK_SIZE; chunkCol <= (range.lastCol - 1) / TILE_CHUNK_SIZE; ++chunkCol)
+        {
+            const TileChunk* chunk = layer.findChunk(chunkRow, chunkCol);
+            if (chunk == nullptr || chunk->occupiedCount == 0)
+                continue;
+
+            ImVec2 chunkPos(origin.x + chunkCol * TILE_CHUNK_SIZE * m_tileSize.x, origin.y + chunkRow * TILE_CHUNK_SIZE * m_tileSize.y);
+            count += appendQuads(drawList, chunk->getQuads(), chunkPos, m_tileSize);
+        }
+    }
+    return count;
+}
+
+int Grid::appendComposite(ImDrawList* drawList, ImVec2 origin, const CellRange& range)
+{
+    TILE_TRACE_SCOPE("Grid::render composite");
+    m_visibleLayers.clear();
+    for (const NumberedLayer& layer : m_tileLayers)
+    {
+        if (layer.layer.getVisibility())
+            m_visibleLayers.push_back(&layer.layer);
+    }
+
+    m_compositor.beginFrame();
+    const ImVec2 chunkSize(TILE_CHUNK_SIZE * m_tileSize.x, TILE_CHUNK_SIZE * m_tileSize.y);
+    int count = 0;
+    for (int chunkRow = range.firstRow / TILE_CHUNK_SIZE; chunkRow <= (range.lastRow - 1) / TILE_CHUNK_SIZE; ++chunkRow)
+    {
+        for (int chunkCol = range.firstCol / TILE_CHUNK_SIZE; chunkCol <= (range.lastCol - 1) / TILE_CHUNK_SIZE; ++chunkCol)
+        {
+            const CompositeChunk& chunk = m_compositor.composite(m_visibleLayers, chunkRow, chunkCol);
+            if (chunk.empty)
+                continue;
+
+            ImVec2 chunkPos(origin.x + chunkCol * chunkSize.x, origin.y + chunkRow * chunkSize.y);
+            drawList->AddImage(m_compositeTextures->getTexture(chunkRow, chunkCol, chunk), chunkPos, ImVec2(chunkPos.x + chunkSize.x, chunkPos.y + chunkSize.y));
+            ++count;
+        }
+    }
+    m_compositor.trim(COMPOSITE_CACHE_CHUNKS);
+    return count;
+}
+
+void Grid::renderFloating(ImDrawList* drawList, const TileLayer& layer, int row, int col)
+{
+    TILE_TRACE_SCOPE("Grid::renderFloating");
+    ImVec2 canvasPos = ImGui::GetCursorScreenPos();
+    ImVec2 origin(canvasPos.x + col * m_tileSize.x, canvasPos.y + row * m_tileSize.y);
+    CellRange range = visibleCells(drawList, origin, m_tileSize);
+    if (range.firstRow < range.lastRow && range.firstCol < range.lastCol)
+        m_emittedQuads += appendLayer(drawList, layer, origin, range);
+}
+
+void Grid::render(ImDrawList* drawList, ImVec2 cellSize, int highlightCellX, int highlightCellY, bool showGrid, float gridThickness) {
+    TILE_TRACE_SCOPE("Grid::render");
+    ImVec2 windowPos = ImGui::GetCursorScreenPos();
+
+    m_cellSize = cellSize;
+    m_emittedQuads = 0;
+    //Draws only visible layers, up the layer stack. New Layers are added on Top of Old ones
+    //Only chunks overlapping the "GridChild" clip rect are submitted, from their cached quads
+    CellRange range = visibleCells(drawList, windowPos, m_tileSize);
+    if (range.firstRow < range.lastRow && range.firstCol < range.lastCol)
+    {
+        if (m_compositeTextures != nullptr)
+        {
+            m_emittedQuads += appendComposite(drawList, windowPos, range);
+        }
+        else
+        {
+            for (const NumberedLayer& layer : m_tileLayers)
+            {
+                if (layer.layer.getVisibility() == true)
+                {
+                    TILE_TRACE_SCOPE_ARG("Grid::render layer", "layer", layer.number);
+                    m_emittedQuads += appendLayer(drawList, layer.layer, windowPos, range);
+                }
+            }
+        }
+    }
+    if (showGrid) {
+        TILE_TRACE_SCOPE("Grid::render lines");
+        //Lines outside of the clip rect are skipped, a line thickness of margin keeps partially visible ones
+        ImVec2 clipMin = drawList->GetClipRectMin();
+        ImVec2 clipMax = drawList->GetClipRectMax();
+        float gridBottom = std::min(windowPos.y + m_canvasSize.y, clipMax.y + gridThickness);
+        float gridRight = std::min(windowPos.x + m_canvasSize.x, clipMax.x + gridThickness);
+
+        // Render horizontal grid lines
+        drawList->AddLine(ImVec2(windowPos.x, windowPos.y), ImVec2(windowPos.x + m_canvasSize.x, windowPos.y), IM_COL32(150, 150, 150, 255), gridThickness);
+        float firstLine = std::max(1.0f, std::floor((clipMin.y - gridThickness - windowPos.y) / m_cellSize.y));
+        for (float y = windowPos.y + firstLine * m_cellSize.y - 1; y < gridBottom; y += m_cellSize.y) {
+            drawList->AddLine(ImVec2(windowPos.x, y), ImVec2(windowPos.x + m_canvasSize.x, y), IM_COL32(150, 150, 150, 255), gridThickness);
+        }
+
+        // Render vertical grid lines
+        drawList->AddLine(ImVec2(windowPos.x, windowPos.y), ImVec2(windowPos.x, windowPos.y + m_canvasSize.y), IM_COL32(150, 150, 150, 255), gridThickness);
+        firstLine = std::max(1.0f, std::floor((clipMin.x - gridThickness - windowPos.x) / m_cellSize.x));
+        for (float x = windowPos.x + firstLine * m_cellSize.x - 1; x < gridRight; x += m_cellSize.x) {
+            drawList->AddLine(ImVec2(x, windowPos.y), ImVec2(x, windowPos.y + m_canvasSize.y), IM_COL32(150, 150, 150, 255), gridThickness);
+        }
+    }
+           
+}
+
+void Grid::setCellColor(int pensize, int row, int col, ImU32 color) {
+
+    //Mouse draws only on selected layer ID.
+    //selected layer ID is looked up in the stack index of TileLayers to be modified.
+    TileLayer* selected = findLayer(m_selectedLayer);
+    if (selected != nullptr)
+    {
+        int block = std::max(1, pensize / static_cast<int>(m_tileSize.x));
+        m_history.recordFill(m_selectedLayer, *selected, row * block, col * block, (row + 1) * block, (col + 1) * block, TileLayer::normalize(color));
+        selected->fillRect(row * block, col * block, (row + 1) * block, (col + 1) * block, color);
+    }
+}
+
+int Grid::strokeTo(int pensize, const Brush& brush, int row, int col, ImU32 color)
+{
+    TILE_TRACE_SCOPE("Grid::strokeTo");
+    const std::vector<TileSpan>& stamp = brush.getSpans();
+    const int stampFirstRow = stamp.front().row;
+    const int stampLastRow = stamp.back().row + 1;
+
+    //Brush positions of this sample: the sample alone, or the line from the previous one whose
+    //own stamp is already painted
+    int fromRow = m_hasStrokeSample ? m_strokeRow : row;
+    int fromCol = m_hasStrokeSample ? m_strokeCol : col;
+    bool skipFirst = m_hasStrokeSample;
+    if (skipFirst && fromRow == row && fromCol == col)
+        return 0;
+    m_hasStrokeSample = true;
+    m_strokeRow = row;
+    m_strokeCol = col;
+
+    const int firstRow = std::min(fromRow, row) + stampFirstRow;
+    m_strokeSpans.clear();
+    m_strokeRowSpan.assign(std::max(fromRow, row) + stampLastRow - firstRow, -1);
+    bool oneSpanPerRow = true;
+    auto addStamp = [&](int stampRow, int stampCol) {
+        for (const TileSpan& span : stamp)
+        {
+            int penRow = stampRow + span.row;
+            int first = stampCol + span.firstCol;
+            int last = stampCol + span.lastCol;
+            //Consecutive stamps overlap, so a span mostly extends the last one of its row
+            int& index = m_strokeRowSpan[penRow - firstRow];
+            if (index >= 0 && first <= m_strokeSpans[index].lastCol && last >= m_strokeSpans[index].firstCol)
+            {
+                m_strokeSpans[index].firstCol = std::min(m_strokeSpans[index].firstCol, first);
+                m_strokeSpans[index].lastCol = std::max(m_strokeSpans[index].lastCol, last);
+                continue;
+            }
+            oneSpanPerRow &= index < 0;
+            index = static_cast<int>(m_strokeSpans.size());
+            m_strokeSpans.push_back({ penRow, first, last });
+        }
+    };
+
+    //Bresenham from the previous sample
+    int dRow = std::abs(row - fromRow);
+    int dCol = std::abs(col - fromCol);
+    int stepRow = fromRow < row ? 1 : -1;
+    int stepCol = fromCol < col ? 1 : -1;
+    int error = dCol - dRow;
+    if (!skipFirst)
+        addStamp(fromRow, fromCol);
+    while (fromRow != row || fromCol != col)
+    {
+        int twice = 2 * error;
+        if (twice > -dRow)
+        {
+            error -= dRow;
+            fromCol += stepCol;
+        }
+        if (twice < dCol)
+        {
+            error += dCol;
+            fromRow += stepRow;
+        }
+        addStamp(fromRow, fromCol);
+    }
+
+    //Rows holding several runs, from custom brushes or a row gaining a second span, are put in
+    //order and merged once
+    if (!oneSpanPerRow)
+    {
+        std::sort(m_strokeSpans.begin(), m_strokeSpans.end(), [](const TileSpan& a, const TileSpan& b) {
+            return a.row != b.row ? a.row < b.row : a.firstCol < b.firstCol;
+        });
+        size_t merged = 0;
+        for (size_t i = 1; i < m_strokeSpans.size(); ++i)
+        {
+            TileSpan& last = m_strokeSpans[merged];
+            if (m_strokeSpans[i].row == last.row && m_strokeSpans[i].firstCol <= last.lastCol)
+                last.lastCol = std::max(last.lastCol, m_strokeSpans[i].lastCol);
+            else
+                m_strokeSpans[++merged] = m_strokeSpans[i];
+        }
+        m_strokeSpans.resize(merged + 1);
+    }
+
+    //Pen cells are blocks of tiles
+    int block = std::max(1, pensize / static_cast<int>(m_tileSize.x));
+    if (color != m_strokeColor || block != m_strokeBlock)
+    {
+        clearStrokeMask();
+        m_strokeColor = color;
+        m_strokeBlock = block;
+    }
+    const int penRows = (m_numRows + block - 1) / block;
+    const int penCols = (m_numCols + block - 1) / block;
+    const int words = (penCols + TILE_CHUNK_SIZE - 1) / TILE_CHUNK_SIZE;
+    if (m_strokeMask.size() != static_cast<size_t>(penRows) * words)
+        m_strokeMask.assign(static_cast<size_t>(penRows) * words, 0);
+
+    //Only the runs of pen cells not painted yet in the stroke are written
+    int written = 0;
+    std::vector<TileSpan> spans;
+    auto addRun = [&](int penRow, int first, int last) {
+        written += last - first;
+        for (int i = 0; i < block; ++i)
+            spans.push_back({ penRow * block + i, first * block, last * block });
+    };
+    for (const TileSpan& span : m_strokeSpans)
+    {
+        int first = std::max(span.firstCol, 0);
+        int last = std::min(span.lastCol, penCols);
+        if (span.row < 0 || span.row >= penRows || first >= last)
+            continue;
+
+        //A run reaching the end of a word is held back in case it goes on in the next one
+        int runFirst = -1, runLast = -1;
+        for (int word = first / TILE_CHUNK_SIZE; word <= (last - 1) / TILE_CHUNK_SIZE; ++word)
+        {
+            int base = word * TILE_CHUNK_SIZE;
+            size_t index = static_cast<size_t>(span.row) * words + word;
+            uint32_t fresh = tileSpanMask(std::max(first - base, 0), std::min(last - base, TILE_CHUNK_SIZE)) & ~m_strokeMask[index];
+            if (fresh == 0)
+                continue;
+            if (m_strokeMask[index] == 0)
+                m_strokeWords.push_back(index);
+            m_strokeMask[index] |= fresh;
+
+            while (fresh != 0)
+            {
+                int bit = lowestSetBit(fresh);
+                uint32_t above = ~(fresh >> bit);
+                int end = above == 0 ? TILE_CHUNK_SIZE : bit + lowestSetBit(above);
+                fresh &= ~tileSpanMask(bit, end);
+                if (runLast == base + bit)
+                {
+                    runLast = base + end;
+                    continue;
+                }
+                if (runFirst >= 0)
+                    addRun(span.row, runFirst, runLast);
+                runFirst = base + bit;
+                runLast = base + end;
+            }
+        }
+        if (runFirst >= 0)
+            addRun(span.row, runFirst, runLast);
+    }
+    if (!spans.empty())
+        paintSpans(std::move(spans), color);
+    return written;
+}
+
+void Grid::clearStrokeMask()
+{
+    for (size_t index : m_strokeWords)
+        m_strokeMask[index] = 0;
+    m_strokeWords.clear();
+}
+
+void Grid::copyRegion(int firstRow, int firstCol, int lastRow, int lastCol, TileBuffer& buffer)
+{
+    TILE_TRACE_SCOPE("Grid::copyRegion");
+    buffer.rows = std::max(lastRow - firstRow, 0);
+    buffer.cols = std::max(lastCol - firstCol, 0);
+    TileLayer* selected = findLayer(m_selectedLayer);
+    if (selected != nullptr)
+        selected->readRect(firstRow, firstCol, buffer);
+    else
+        buffer.cells.assign(static_cast<size_t>(buffer.rows) * buffer.cols, IM_COL32_BLACK_TRANS);
+}
+
+void Grid::clearRegion(int firstRow, int firstCol, int lastRow, int lastCol)
+{
+    TileLayer* selected = findLayer(m_selectedLayer);
+    if (selected == nullptr)
+        return;
+
+    m_history.recordFill(m_selectedLayer, *selected, firstRow, firstCol, lastRow, lastCol, IM_COL32_BLACK_TRANS);
+    selected->fillRect(firstRow, firstCol, lastRow, lastCol, IM_COL32_BLACK_TRANS);
+}
+
+void Grid::pasteRegion(int row, int col, const TileBuffer& buffer)
+{
+    TILE_TRACE_SCOPE("Grid::pasteRegion");
+    TileLayer* selected = findLayer(m_selectedLayer);
+    int firstRow = std::max(row, 0);
+    int firstCol = std::max(col, 0);
+    int lastRow = std::min(row + buffer.rows, m_numRows);
+    int lastCol = std::min(col + buffer.cols, m_numCols);
+    if (selected == nullptr || firstRow >= lastRow || firstCol >= lastCol)
+        return;
+
+    //Only the part over the canvas is written
+    const TileBuffer* source = &buffer;
+    TileBuffer clipped;
+    if (firstRow != row || firstCol != col || lastRow - firstRow != buffer.rows || lastCol - firstCol != buffer.cols)
+    {
+        clipped.rows = lastRow - firstRow;
+        clipped.cols = lastCol - firstCol;
+        clipped.cells.resize(static_cast<size_t>(clipped.rows) * clipped.cols);
+        for (int i = 0; i < clipped.rows; ++i)
+            std::memcpy(clipped.row(i), buffer.row(firstRow - row + i) + (firstCol - col), sizeof(ImU32) * clipped.cols);
+        source = &clipped;
+    }
+
+    m_history.recordWrite(m_selectedLayer, *selected, firstRow, firstCol, *source);
+    selected->writeRect(firstRow, firstCol, *source);
+}
+
+void Grid::paintSpans(std::vector<TileSpan> spans, ImU32 color)
+{
+    TILE_TRACE_SCOPE("Grid::paintSpans");
+    TileLayer* selected = findLayer(m_selectedLayer);
+    if (selected == nullptr)
+        return;
+
+    spans.erase(std::remove_if(spans.begin(), spans.end(), [&](TileSpan& span) {
+        span.firstCol = std::max(span.firstCol, 0);
+        span.lastCol = std::min(span.lastCol, m_numCols);
+        return span.row < 0 || span.row >= m_numRows || span.firstCol >= span.lastCol;
+    }), spans.end());
+
+    color = TileLayer::normalize(color);
+    m_history.recordSpans(m_selectedLayer, *selected, spans, color);
+    selected->fillSpans(spans, color);
+}
+
+size_t Grid::floodFill(int row, int col, ImU32 color, bool diagonal, bool sampleVisibleLayers)
+{
+    TILE_TRACE_SCOPE("Grid::floodFill");
+    TileLayer* selected = findLayer(m_selectedLayer);
+    if (selected == nullptr || row < 0 || col < 0 || row >= m_numRows || col >= m_numCols)
+        return 0;
+
+    color = TileLayer::normalize(color);
+    std::vector<const TileLayer*> sampled;
+    if (sampleVisibleLayers)
+    {
+        for (const NumberedLayer& layer : m_tileLayers)
+        {
+            if (layer.layer.getVisibility())
+                sampled.push_back(&layer.layer);
+        }
+    }
+    else
+    {
+        sampled.push_back(selected);
+        if (selected->getTile(row, col) == color)
+            return 0;
+    }
+    RegionSampler sampler(sampled, row, col);
+
+    //Matching cells and cells already in the region, one word per chunk row, laid out like the
+    //canvas. A chunk is sampled whole the first time the fill reaches it.
+    const int chunkCols = (m_numCols + TILE_CHUNK_SIZE - 1) / TILE_CHUNK_SIZE;
+    const int chunkRows = (m_numRows + TILE_CHUNK_SIZE - 1) / TILE_CHUNK_SIZE;
+    std::vector<uint32_t> matching(static_cast<size_t>(chunkCols) * chunkRows * TILE_CHUNK_SIZE);
+    std::vector<uint32_t> visited(matching.size());
+    std::vector<bool> sampledChunks(static_cast<size_t>(chunkCols) * chunkRows);
+    //Cells of a chunk row within range that match and are not in the region yet
+    auto openMask = [&](int r, int chunkCol, uint32_t range) {
+        int canvasCols = std::min(m_numCols - chunkCol * TILE_CHUNK_SIZE, TILE_CHUNK_SIZE);
+        size_t word = static_cast<size_t>(r) * chunkCols + chunkCol;
+        uint32_t candidates = range & ~visited[word] & tileSpanMask(0, canvasCols);
+        if (candidates == 0)
+            return 0u;
+
+        size_t chunk = static_cast<size_t>(r / TILE_CHUNK_SIZE) * chunkCols + chunkCol;
+        if (!sampledChunks[chunk])
+        {
+            uint32_t rowMasks[TILE_CHUNK_SIZE];
+            sampler.matchChunk(r / TILE_CHUNK_SIZE, chunkCol, rowMasks);
+            for (int i = 0; i < TILE_CHUNK_SIZE; ++i)
+                matching[(static_cast<size_t>(r / TILE_CHUNK_SIZE) * TILE_CHUNK_SIZE + i) * chunkCols + chunkCol] = rowMasks[i];
+            sampledChunks[chunk] = true;
+        }
+        return candidates & matching[word];
+    };
+
+    std::vector<std::pair<int, int>> seeds = { { row, col } };
+    const int reach = diagonal ? 1 : 0;
+    while (!seeds.empty())
+    {
+        int seedRow = seeds.back().first;
+        int seedCol = seeds.back().second;
+        seeds.pop_back();
+        int chunkCol = seedCol / TILE_CHUNK_SIZE;
+        int bit = seedCol % TILE_CHUNK_SIZE;
+        uint32_t open = openMask(seedRow, chunkCol, ~0u);
+        if ((open >> bit & 1) == 0)
+            continue;
+
+        //Extends the run around the seed word by word
+        int first, last;
+        uint32_t closedBelow = ~open & ((1u << bit) - 1);
+        if (closedBelow != 0)
+        {
+            first = chunkCol * TILE_CHUNK_SIZE + highestSetBit(closedBelow) + 1;
+        }
+        else
+        {
+            int word = chunkCol;
+            uint32_t left = 0;
+            while (word > 0 && (left = openMask(seedRow, word - 1, ~0u)) == ~0u)
+                --word;
+            first = word * TILE_CHUNK_SIZE;
+            if (word > 0)
+                first += highestSetBit(~left) + 1 - TILE_CHUNK_SIZE;
+        }
+        uint32_t closedAbove = ~open & ~((2u << bit) - 1);
+        if (closedAbove != 0)
+        {
+            last = chunkCol * TILE_CHUNK_SIZE + lowestSetBit(closedAbove);
+        }
+        else
+        {
+            int word = chunkCol + 1;
+            uint32_t right = 0;
+            while (word < chunkCols && (right = openMask(seedRow, word, ~0u)) == ~0u)
+                ++word;
+            last = word * TILE_CHUNK_SIZE;
+            if (word < chunkCols)
+                last += lowestSetBit(~right);
+        }
+
+        for (int word = first / TILE_CHUNK_SIZE; word <= (last - 1) / TILE_CHUNK_SIZE; ++word)
+        {
+            int base = word * TILE_CHUNK_SIZE;
+            visited[static_cast<size_t>(seedRow) * chunkCols + word] |= tileSpanMask(std::max(first - base, 0), std::min(last - base, TILE_CHUNK_SIZE));
+        }
+
+        //One seed per run of open cells next to the run, its own scan extends it
+        int lo = std::max(first - reach, 0);
+        int hi = std::min(last + reach, m_numCols);
+        for (int nextRow = seedRow - 1; nextRow <= seedRow + 1; nextRow += 2)
+        {
+            if (nextRow < 0 || nextRow >= m_numRows)
+                continue;
+            uint32_t carry = 0;
+            for (int word = lo / TILE_CHUNK_SIZE; word <= (hi - 1) / TILE_CHUNK_SIZE; ++word)
+            {
+                int base = word * TILE_CHUNK_SIZE;
+                uint32_t next = openMask(nextRow, word, tileSpanMask(std::max(lo - base, 0), std::min(hi - base, TILE_CHUNK_SIZE)));
+                uint32_t starts = next & ~(next << 1 | carry);
+                carry = next >> 31;
+                while (starts != 0)
+                {
+                    seeds.push_back({ nextRow, base + lowestSetBit(starts) });
+                    starts &= starts - 1;
+                }
+            }
+        }
+    }
+
+    //Written once the region is known, so the sampler never sees filled cells
+    size_t filled = 0;
+    m_history.begin();
+    uint32_t rowMasks[TILE_CHUNK_SIZE];
+    for (int chunkRow = 0; chunkRow * TILE_CHUNK_SIZE < m_numRows; ++chunkRow)
+    {
+        for (int chunkCol = 0; chunkCol < chunkCols; ++chunkCol)
+        {
+            uint32_t any = 0;
+            for (int r = 0; r < TILE_CHUNK_SIZE; ++r)
+            {
+                int canvasRow = chunkRow * TILE_CHUNK_SIZE + r;
+                rowMasks[r] = canvasRow < m_numRows ? visited[static_cast<size_t>(canvasRow) * chunkCols + chunkCol] : 0;
+                any |= rowMasks[r];
+                filled += bitCount(rowMasks[r]);
+            }
+            if (any == 0)
+                continue;
+            m_history.recordFillMasked(m_selectedLayer, *selected, chunkRow, chunkCol, rowMasks, color);
+            selected->fillChunkMasked(chunkRow, chunkCol, rowMasks, color);
+        }
+    }
+    m_history.end();
+    return filled;
+}
+
+bool Grid::isValidSize(ImVec2 canvasSize, ImVec2 tileSize)
+{
+    //Comparisons with NaN are false, so NaN sizes fail too. The cell counts are bounded before
+    //the constructor casts them to int.
+    return tileSize.x >= 1.0f && tileSize.y >= 1.0f && std::isfinite(tileSize.x) && std::isfinite(tileSize.y) &&
+        canvasSize.x >= 0.0f && canvasSize.y >= 0.0f &&
+        canvasSize.x / tileSize.x <= MAX_CANVAS_CELLS && canvasSize.y / tileSize.y <= MAX_CANVAS_CELLS;
+}
+
+bool Grid::setLayers(std::vector<NumberedLayer> layers, int selectedLayer)
+{
+    std::vector<bool> used;
+    for (const NumberedLayer& layer : layers)
+    {
+        if (layer.number < 1 || layer.number > MAX_LAYER_NUMBER)
+            return false;
+        if (layer.number >= static_cast<int>(used.size()))
+            used.resize(layer.number + 1);
+        if (used[layer.number])
+            return false;
+        used[layer.number] = true;
+    }
+
+    m_history.clear();
+    m_tileLayers = std::move(layers);
+    m_selectedLayer = selectedLayer;
+    for (NumberedLayer& layer : m_tileLayers)
+        layer.layer.setUseEpoch(m_useEpoch);
+    indexLayers();
+    return true;
+}
+
+void Grid::indexLayers()
+{
+    m_layerIndex.clear();
+    for (int i = 0; i < static_cast<int>(m_tileLayers.size()); ++i)
+    {
+        int number = m_tileLayers[i].number;
+        if (number >= static_cast<int>(m_layerIndex.size()))
+            m_layerIndex.resize(number + 1, -1);
+        m_layerIndex[number] = i;
+    }
+}
+
+const std::shared_ptr<ChunkStore>& Grid::getChunkStore()
+{
+    if (m_chunkStore == nullptr)
+        m_chunkStore = std::make_shared<ChunkStore>();
+    return m_chunkStore;
+}
+
+void Grid::detachLayersFrom(const std::string& path)
+{
+    for (NumberedLayer& layer : m_tileLayers)
+    {
+        const MappedFile* file = layer.layer.getMappedFile();
+        if (file != nullptr && file->getPath() == path)
+            layer.layer.detachMapped(getChunkStore());
+    }
+    //Deleted layers kept for undo may still page in from the file too
+    m_history.detachMapped(path, getChunkStore());
+}
+
+size_t Grid::getResidentChunkCount() const
+{
+    size_t resident = 0;
+    for (const NumberedLayer& layer : m_tileLayers)
+        resident += layer.layer.getAllocatedChunkCount();
+    return resident;
+}
+
+size_t Grid::trimResidentChunks()
+{
+    TILE_TRACE_SCOPE("Grid::trimResidentChunks");
+    const uint32_t epoch = m_useEpoch++;
+    for (NumberedLayer& layer : m_tileLayers)
+        layer.layer.setUseEpoch(m_useEpoch);
+
+    size_t resident = getResidentChunkCount();
+    if (m_chunkBudgetBytes == 0 || resident * sizeof(TileChunk) <= m_chunkBudgetBytes)
+        return 0;
+
+    //Trimming below the budget leaves headroom, so painting into new chunks does not evict every frame
+    const size_t target = m_chunkBudgetBytes / 8 * 7 / sizeof(TileChunk);
+    struct Candidate
+    {
+        uint32_t lastUse;
+        //Stack index
+        int layer;
+        int chunkRow, chunkCol;
+    };
+    std::vector<Candidate> candidates;
+    for (int i = 0; i < static_cast<int>(m_tileLayers.size()); ++i)
+    {
+        m_tileLayers[i].layer.forEachResidentChunk([&](int chunkRow, int chunkCol, const TileChunk& chunk) {
+            if (chunk.lastUse != epoch)
+                candidates.push_back({ chunk.lastUse, i, chunkRow, chunkCol });
+        });
+    }
+
+    size_t wanted = std::min(resident - std::min(resident, target), candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + wanted, candidates.end(),
+        [](const Candidate& a, const Candidate& b) { return a.lastUse < b.lastUse; });
+
+    size_t evicted = 0;
+    for (size_t i = 0; i < wanted; ++i)
+    {
+        if (m_tileLayers[candidates[i].layer].layer.evictChunk(candidates[i].chunkRow, candidates[i].chunkCol, getChunkStore()))
+            ++evicted;
+    }
+    return evicted;
+}
+
+int Grid::addLayer()
+{
+    //New layers take the lowest free layer number and go on top of the stack
+    for (int i = 1; i <= static_cast<int>(m_tileLayers.size()) + 1 && i <= MAX_LAYER_NUMBER; i++)
+    {
+        if (getLayerIndex(i) < 0)
+        {
+            const int index = static_cast<int>(m_tileLayers.size());
+            m_tileLayers.push_back({ i, TileLayer() });
+            m_tileLayers.back().layer.setUseEpoch(m_useEpoch);
+            indexLayers();
+            m_history.recordAddLayer(i, index, m_selectedLayer);
+            m_selectedLayer = i;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void Grid::deleteSelectedLayer()
+{
+    const int index = getLayerIndex(m_selectedLayer);
+    if (index < 0)
+        return;
+
+    const int deleted = m_selectedLayer;
+    TileLayer removed = removeLayer(deleted);
+    //The layer that moved into its place is selected, or the one below when it was the top one
+    if (index < static_cast<int>(m_tileLayers.size()))
+        m_selectedLayer = m_tileLayers[index].number;
+    else if (index > 0)
+        m_selectedLayer = m_tileLayers[index - 1].number;
+    else
+        m_selectedLayer = 0;
+    m_history.recordDeleteLayer(deleted, index, std::move(removed), deleted, m_selectedLayer);
+}
+
+void Grid::moveLayer(int layerNumber, int index)
+{
+    const int from = getLayerIndex(layerNumber);
+    index = std::min(std::max(index, 0), static_cast<int>(m_tileLayers.size()) - 1);
+    if (from < 0 || from == index)
+        return;
+
+    m_history.recordMoveLayer(layerNumber, from, index);
+    placeLayer(layerNumber, index);
+}
+
+void Grid::insertLayer(int layerNumber, int index, TileLayer layer)
+{
+    if (getLayerIndex(layerNumber) >= 0)
+        removeLayer(layerNumber);
+    index = std::min(std::max(index, 0), static_cast<int>(m_tileLayers.size()));
+    TileLayer& inserted = m_tileLayers.insert(m_tileLayers.begin() + index, { layerNumber, std::move(layer) })->layer;
+    inserted.setUseEpoch(m_useEpoch);
+    //The journal dropped the layer when it was removed, its chunks are written again
+    inserted.markAllUnsaved();
+    indexLayers();
+}
+
+TileLayer Grid::removeLayer(int layerNumber)
+{
+    TileLayer layer;
+    const int index = getLayerIndex(layerNumber);
+    if (index >= 0)
+    {
+        layer = std::move(m_tileLayers[index].layer);
+        m_tileLayers.erase(m_tileLayers.begin() + index);
+        indexLayers();
+    }
+    return layer;
+}
+
+void Grid::placeLayer(int layerNumber, int index)
+{
+    const int from = getLayerIndex(layerNumber);
+    index = std::min(std::max(index, 0), static_cast<int>(m_tileLayers.size()) - 1);
+    if (from < 0 || from == index)
+        return;
+
+    //The layers in between shift by one towards from
+    if (from < index)
+        std::rotate(m_tileLayers.begin() + from, m_tileLayers.begin() + from + 1, m_tileLayers.begin() + index + 1);
+    else
+        std::rotate(m_tileLayers.begin() + index, m_tileLayers.begin() + from, m_tileLayers.begin() + from + 1);
+    indexLayers();
+}
+
+void Grid::drawLayerWindow() {
+    ImGui::SetNextWindowSizeConstraints(ImVec2(250, -1), ImVec2(FLT_MAX, -1));
+    ImGui::Begin("Layers", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+
+    //Listed top of the stack first. Dragging a layer onto another moves it to that one's place,
+    //once the list is drawn.
+    int movedLayer = -1;
+    int movedTo = -1;
+    for (int index = static_cast<int>(m_tileLayers.size()) - 1; index >= 0; --index)
+    {
+        int layerNumber = m_tileLayers[index].number;
+        bool isSelected = (m_selectedLayer == layerNumber);
+
+        ImGui::Checkbox(("##" + std::to_string(layerNumber)).c_str(), &(m_tileLayers[index].layer.isVisible()));
+
+        ImGui::SameLine();
+        if (ImGui::Selectable(("Layer : " + std::to_string(layerNumber)).c_str(), isSelected)) {
+            m_selectedLayer = layerNumber;
+        }
+        if (ImGui::BeginDragDropSource())
+        {
+            ImGui::SetDragDropPayload("TILE_LAYER", &layerNumber, sizeof(layerNumber));
+            ImGui::Text("Layer : %d", layerNumber);
+            ImGui::EndDragDropSource();
+        }
+        if (ImGui::BeginDragDropTarget())
+        {
+            if (const ImGuiPayload* payload = ImGui::AcceptDragDropPayload("TILE_LAYER"))
+            {
+                std::memcpy(&movedLayer, payload->Data, sizeof(movedLayer));
+                movedTo = index;
+            }
+            ImGui::EndDragDropTarget();
+        }
+    }
+    if (movedLayer >= 0)
+        moveLayer(movedLayer, movedTo);
+    if (ImGui::Button("Add"))
+    {
+        addLayer();
+    }
+    ImGui::SameLine();
+
+    if (ImGui::Button("Delete"))
+    {
+        deleteSelectedLayer();
+    }
+    ImGui::End();
+}
@@ -0,0 +1,304 @@
+#pragma once
+#include <imgui.h>
+#include "Brush.h"
+#include "Compositor.h"
+#include "TileHistory.h"
+#include "TileLayer.h"
+#include <cmath>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+//Layer of the grid's stack with the number it keeps while it is moved around the stack.
+//History records, the autosave journal and project files refer to layers by number.
+struct NumberedLayer
+{
+    int number;
+    TileLayer layer;
+};
+
+class Grid
+{
+private:
+    ImVec2 m_canvasSize;
+    ImVec2 m_cellSize;
+    //Size of one canonical tile. Layers store tiles at this resolution only.
+    ImVec2 m_tileSize;
+    int m_numRows;
+    int m_numCols;
+    //Layer stack, bottom first: the order layers are drawn and composited in
+    std::vector<NumberedLayer> m_tileLayers;
+    //Stack index of each layer number, -1 for numbers without a layer, so painting the selected
+    //layer finds it without a search
+    std::vector<int> m_layerIndex;
+    int m_selectedLayer = 1;
+    int m_emittedQuads = 0;
+
+    //Out-of-core paging: once the resident chunks of all layers exceed the budget, the least
+    //recently used ones are evicted into the chunk store. 0 keeps every chunk resident.
+    size_t m_chunkBudgetBytes = 0;
+    uint32_t m_useEpoch = 1;
+    std::shared_ptr<ChunkStore> m_chunkStore;
+
+    TileHistory m_history;
+
+    //Flattened layers, drawn instead of every layer's quads when the renderer provides textures.
+    //Composites of chunks out of view are kept up to COMPOSITE_CACHE_CHUNKS, 4 KiB each.
+    static constexpr size_t COMPOSITE_CACHE_CHUNKS = 4096;
+    LayerCompositor m_compositor;
+    CompositeTextures* m_compositeTextures = nullptr;
+    std::vector<const TileLayer*> m_visibleLayers;
+
+    //Last sample of the stroke the next one is joined to
+    bool m_hasStrokeSample = false;
+    int m_strokeRow = 0;
+    int m_strokeCol = 0;
+    //Scratch of strokeTo: the stamps of a sample merged per pen row, and the last span of each row
+    std::vector<TileSpan> m_strokeSpans;
+    std::vector<int> m_strokeRowSpan;
+    //Pen cells painted since beginStroke, one bit each in words of TILE_CHUNK_SIZE pen columns laid
+    //out like the pen grid, and the words set so far, which are all that is cleared for the next
+    //stroke. Painting in another colour or pen size starts it over.
+    std::vector<uint32_t> m_strokeMask;
+    std::vector<size_t> m_strokeWords;
+    ImU32 m_strokeColor = IM_COL32_BLACK_TRANS;
+    int m_strokeBlock = 0;
+
+    const std::shared_ptr<ChunkStore>& getChunkStore();
+    void clearStrokeMask();
+    void indexLayers();
+
+public:
+    Grid(ImVec2 canvasSize, ImVec2 cellSize);
+
+    //Range of cells of the given size overlapping the draw list clip rect, clamped to the grid.
+    //Last row and column are exclusive, the range is empty when the canvas is clipped away.
+    struct CellRange
+    {
+        int firstRow, lastRow;
+        int firstCol, lastCol;
+    };
+
+    CellRange visibleCells(const ImDrawList* drawList, ImVec2 origin, ImVec2 cellSize) const;
+
+    //Appends the cached quads of the chunks of layer overlapping range, with layer cell (0, 0) at origin
+    int appendLayer(ImDrawList* drawList, const TileLayer& layer, ImVec2 origin, const CellRange& range);
+
+    //Draws the composite of the visible layers of every chunk in range as one textured quad
+    int appendComposite(ImDrawList* drawList, ImVec2 origin, const CellRange& range);
+
+    //Copies cached chunk quads into the draw list with a single reservation.
+    //A chunk has at most TILE_CHUNK_CELLS quads, so one reservation always fits in a 16-bit
+    //index window and the renderer's VtxOffset support takes care of larger draw lists.
+    static int appendQuads(ImDrawList* drawList, const std::vector<TileQuad>& quads, ImVec2 chunkPos, ImVec2 tileSize);
+
+    //Draws spans of tiles as filled rectangles, rows with the same span merged into one.
+    //Used to preview shapes without writing them to a layer.
+    static int appendSpans(ImDrawList* drawList, const std::vector<TileSpan>& spans, ImVec2 origin, ImVec2 tileSize, ImU32 color);
+
+    //Draws layer with its cell (0, 0) at canvas cell (row, col) of the current ImGui cursor position,
+    //e.g. a floating selection being moved. Only chunks inside the clip rect are drawn.
+    void renderFloating(ImDrawList* drawList, const TileLayer& layer, int row, int col);
+
+    //Draws the layers and grid lines at the current ImGui cursor position
+    void render(ImDrawList* drawList, ImVec2 cellSize, int highlightCellX, int highlightCellY, bool showGrid, float gridThickness);
+
+    //When set, render draws the visible layers flattened by the compositor, one textured quad per
+    //chunk, instead of the quads of every layer. nullptr goes back to quads.
+    void setCompositeTextures(CompositeTextures* textures)
+    {
+        m_compositeTextures = textures;
+    }
+
+    const LayerCompositor& getCompositor() const
+    {
+        return m_compositor;
+    }
+
+    //Number of tile quads, or composited chunk quads, submitted by the last render call
+    int getEmittedQuadCount() const
+    {
+        return m_emittedQuads;
+    }
+
+    //Pen sizes are multiples of the tile size: a pen cell (row, col) covers a square block of
+    //tiles, which is written as one block fill into the canonical grid of the selected layer.
+    void setCellColor(int pensize, int row, int col, ImU32 color);
+
+    //Painting between beginStroke and endStroke is undone as one step
+    void beginStroke()
+    {
+        m_history.begin();
+        m_hasStrokeSample = false;
+        clearStrokeMask();
+    }
+
+    void endStroke()
+    {
+        m_history.end();
+        m_hasStrokeSample = false;
+        clearStrokeMask();
+    }
+
+    //Stamps brush with its middle at pen cell (row, col), and at every pen cell on the line from the
+    //previous sample of the stroke, so fast drags leave no gaps. The stamps of a sample are merged
+    //into one span per pen row run, and pen cells already painted since beginStroke are taken out
+    //of the spans, so every pen cell of the stroke is written once whatever the brush size and
+    //however often the stroke crosses itself. Returns the number of pen cells written.
+    int strokeTo(int pensize, const Brush& brush, int row, int col, ImU32 color);
+
+    //The next strokeTo starts a new line, e.g. when the pointer left the canvas
+    void breakStroke()
+    {
+        m_hasStrokeSample = false;
+    }
+
+    bool undo()
+    {
+        return m_history.undo(*this);
+    }
+
+    bool redo()
+    {
+        return m_history.redo(*this);
+    }
+
+    TileHistory& getHistory()
+    {
+        return m_history;
+    }
+
+    //Copies the cells [firstRow, lastRow) x [firstCol, lastCol) of the selected layer into buffer
+    void copyRegion(int firstRow, int firstCol, int lastRow, int lastCol, TileBuffer& buffer);
+
+    //Empties the cells [firstRow, lastRow) x [firstCol, lastCol) of the selected layer
+    void clearRegion(int firstRow, int firstCol, int lastRow, int lastCol);
+
+    //Replaces the cells of the selected layer under buffer placed at (row, col), clipped to the canvas
+    void pasteRegion(int row, int col, const TileBuffer& buffer);
+
+    //Fills spans of tiles of the selected layer, clipped to the canvas, as one undo step
+    void paintSpans(std::vector<TileSpan> spans, ImU32 color);
+
+    //Bucket fill of the selected layer: fills the region of cells connected to (row, col), in
+    //tiles, that hold the same colour as it, bounded by the canvas. Cells are connected through
+    //their edges, and also their corners when diagonal is set. With sampleVisibleLayers the region
+    //is the cells matching (row, col) on every visible layer instead of on the selected one only.
+    //Scanline fill: the region is found as row spans which are then written with fillRect.
+    //Returns the number of cells filled.
+    size_t floodFill(int row, int col, ImU32 color, bool diagonal, bool sampleVisibleLayers);
+
+    //Adds an empty layer, selects it and returns its layer number
+    int addLayer();
+    void deleteSelectedLayer();
+
+    //Moves a layer to a stack index, 0 being the bottom, as one undo step
+    void moveLayer(int layerNumber, int index);
+
+    //Puts a layer back under its number at a stack index, takes one out and moves one, without
+    //recording history
+    void insertLayer(int layerNumber, int index, TileLayer layer);
+    TileLayer removeLayer(int layerNumber);
+    void placeLayer(int layerNumber, int index);
+
+    //Layer numbers are at most MAX_LAYER_NUMBER. New layers take the lowest free number.
+    static constexpr int MAX_LAYER_NUMBER = 65535;
+
+    int getLayerCount() const
+    {
+        return static_cast<int>(m_tileLayers.size());
+    }
+
+    int getSelectedLayer() const
+    {
+        return m_selectedLayer;
+    }
+
+    void selectLayer(int layerNumber)
+    {
+        m_selectedLayer = layerNumber;
+    }
+
+    //Stack index of the layer with the given number, or -1 if there is none
+    int getLayerIndex(int layerNumber) const
+    {
+        return layerNumber >= 0 && layerNumber < static_cast<int>(m_layerIndex.size()) ? m_layerIndex[layerNumber] : -1;
+    }
+
+    //Layer with the given number, or nullptr if there is none
+    TileLayer* findLayer(int layerNumber)
+    {
+        int index = getLayerIndex(layerNumber);
+        return index >= 0 ? &m_tileLayers[index].layer : nullptr;
+    }
+
+    //Layer stack, bottom first
+    const std::vector<NumberedLayer>& getLayers() const
+    {
+        return m_tileLayers;
+    }
+
+    //Replaces every layer with a stack given bottom first, used when a project is opened. Clears the
+    //history. Fails, leaving the grid as it was, when a number repeats or is outside [1, MAX_LAYER_NUMBER].
+    bool setLayers(std::vector<NumberedLayer> layers, int selectedLayer);
+
+    //Moves every chunk still mapped from the project file at path into the chunk store, for the
+    //layers of the grid and the deleted ones kept for undo
+    void detachLayersFrom(const std::string& path);
+
+    //Memory budget of resident chunks over all layers in bytes, 0 for no limit
+    void setChunkBudget(size_t bytes)
+    {
+        m_chunkBudgetBytes = bytes;
+    }
+
+    size_t getChunkBudget() const
+    {
+        return m_chunkBudgetBytes;
+    }
+
+    //Call once per frame after rendering and painting. Chunks accessed since the previous call
+    //form the working set and are kept; older ones are evicted, least recently used first,
+    //until the resident chunks fit in 7/8 of the budget. Returns the number of chunks evicted.
+    size_t trimResidentChunks();
+
+    size_t getResidentChunkCount() const;
+
+    ImVec2 getCanvasSize() const
+    {
+        return m_canvasSize;
+    }
+
+    ImVec2 getTileSize() const
+    {
+        return m_tileSize;
+    }
+
+    //Canvases read from files have at most MAX_CANVAS_CELLS cells along each side
+    static constexpr int MAX_CANVAS_CELLS = 1 << 14;
+
+    //True when a grid can be made from a canvas and tile size read from a file: the sizes are
+    //finite, tiles are at least a pixel wide and the canvas is at most MAX_CANVAS_CELLS cells wide and high
+    static bool isValidSize(ImVec2 canvasSize, ImVec2 tileSize);
+
+    //Number of chunks spanning canvasSize for a valid size, a partial chunk at the edge included.
+    //Files only hold chunks within this span, which bounds the chunk directory a loaded layer allocates.
+    static int canvasChunks(float canvasSize, float tileSize)
+    {
+        return static_cast<int>(std::ceil(canvasSize / tileSize / TILE_CHUNK_SIZE));
+    }
+
+    //Canvas size in tiles
+    int getRowCount() const
+    {
+        return m_numRows;
+    }
+
+    int getColumnCount() const
+    {
+        return m_numCols;
+    }
+
+    void drawLayerWindow();
+};
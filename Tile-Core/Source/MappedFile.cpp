@@ -0,0 +1,84 @@
+#include "MappedFile.h"
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::shared_ptr<const MappedFile> MappedFile::open(const char* path)
+{
+    std::shared_ptr<MappedFile> mapped(new MappedFile());
+    mapped->m_path = path;
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+    mapped->m_file = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+        return nullptr;
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+        return nullptr;
+    mapped->m_mapping = mapping;
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr)
+        return nullptr;
+    mapped->m_data = static_cast<const unsigned char*>(data);
+    mapped->m_size = static_cast<size_t>(size.QuadPart);
+#else
+    int file = ::open(path, O_RDONLY);
+    if (file < 0)
+        return nullptr;
+
+    struct stat status;
+    if (fstat(file, &status) != 0 || status.st_size == 0)
+    {
+        ::close(file);
+        return nullptr;
+    }
+
+    //The mapping keeps the file referenced, the descriptor is not needed once it exists
+    void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if (data == MAP_FAILED)
+        return nullptr;
+    mapped->m_data = static_cast<const unsigned char*>(data);
+    mapped->m_size = static_cast<size_t>(status.st_size);
+#endif
+    return mapped;
+}
+
+MappedFile::~MappedFile()
+{
+#if defined(_WIN32)
+    if (m_data != nullptr)
+        UnmapViewOfFile(m_data);
+    if (m_mapping != nullptr)
+        CloseHandle(m_mapping);
+    if (m_file != nullptr)
+        CloseHandle(m_file);
+#else
+    if (m_data != nullptr)
+        munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+}
+
+bool replaceFile(const char* from, const char* to)
+{
+#if defined(_WIN32)
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from, to) == 0;
+#endif
+}
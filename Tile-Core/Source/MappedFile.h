@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+
+//Read-only memory mapping of a whole file. The mapping lives as long as the object, so
+//layers paging chunks in from a project share ownership of it (see TileChunkGrid).
+class MappedFile
+{
+private:
+    std::string m_path;
+    const unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+#if defined(_WIN32)
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+
+    MappedFile() = default;
+
+public:
+    //Maps the file at path, or returns nullptr if it cannot be opened or is empty
+    static std::shared_ptr<const MappedFile> open(const char* path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const
+    {
+        return m_data;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    const std::string& getPath() const
+    {
+        return m_path;
+    }
+};
+
+//Renames the file at from over the one at to, replacing it in one step. Mappings of the replaced
+//file keep reading its old contents; on Windows a mapped file cannot be replaced and this fails.
+bool replaceFile(const char* from, const char* to);
@@ -0,0 +1,186 @@
+#include "ProjectFile.h"
+#include "Grid.h"
+#include "MappedFile.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    uint64_t alignUp(uint64_t offset, uint64_t alignment)
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    bool writeZeros(FILE* file, uint64_t count)
+    {
+        static const char zeros[PROJECT_CHUNK_ALIGNMENT] = {};
+        while (count != 0)
+        {
+            size_t block = static_cast<size_t>(std::min<uint64_t>(count, sizeof(zeros)));
+            if (std::fwrite(zeros, 1, block, file) != block)
+                return false;
+            count -= block;
+        }
+        return true;
+    }
+
+    template<typename Record>
+    bool readRecord(const MappedFile& file, uint64_t offset, Record& record)
+    {
+        if (offset > file.size() || file.size() - offset < sizeof(Record))
+            return false;
+        std::memcpy(&record, file.data() + offset, sizeof(Record));
+        return true;
+    }
+}
+
+bool saveProject(Grid& grid, const char* path)
+{
+    TILE_TRACE_SCOPE("saveProject");
+    //The project is written next to path and renamed over it, so a failed save leaves the old file
+    //whole and mappings of it, however its path was spelled, keep reading the old cells. Layers
+    //mapping path are still detached first: Windows cannot replace a mapped file.
+    grid.detachLayersFrom(path);
+    const std::string tempPath = std::string(path) + ".tmp";
+
+    //Layers are stored in stack order, bottom first, so the same map always produces the same file
+    std::vector<int> numbers;
+    for (const NumberedLayer& layer : grid.getLayers())
+        numbers.push_back(layer.number);
+
+    //Chunks paged out to the chunk store are only readable during the visit, so the index
+    //is built in a first pass and the cells are written in a second one
+    std::vector<ProjectLayerEntry> layerEntries;
+    std::vector<std::vector<ProjectChunkEntry>> layerIndex;
+    for (int number : numbers)
+    {
+        const TileLayer& layer = *grid.findLayer(number);
+        std::vector<ProjectChunkEntry> index;
+        layer.forEachStoredChunk([&](int chunkRow, int chunkCol, const ImU32*) {
+            index.push_back({ chunkRow, chunkCol, 0 });
+        });
+
+        ProjectLayerEntry entry = {};
+        entry.number = number;
+        entry.visible = layer.getVisibility() ? 1 : 0;
+        entry.chunkCount = static_cast<uint32_t>(index.size());
+        layerEntries.push_back(entry);
+        layerIndex.push_back(std::move(index));
+    }
+
+    uint64_t offset = sizeof(ProjectHeader) + sizeof(ProjectLayerEntry) * layerEntries.size();
+    size_t totalChunks = 0;
+    for (size_t i = 0; i < layerEntries.size(); ++i)
+    {
+        layerEntries[i].indexOffset = offset;
+        offset += sizeof(ProjectChunkEntry) * layerIndex[i].size();
+        totalChunks += layerIndex[i].size();
+    }
+    const uint64_t indexEnd = offset;
+    const uint64_t dataStart = alignUp(indexEnd, PROJECT_CHUNK_ALIGNMENT);
+
+    uint64_t dataOffset = dataStart;
+    for (std::vector<ProjectChunkEntry>& index : layerIndex)
+    {
+        for (ProjectChunkEntry& chunk : index)
+        {
+            chunk.dataOffset = dataOffset;
+            dataOffset += PROJECT_CHUNK_BYTES;
+        }
+    }
+
+    ProjectHeader header = {};
+    std::memcpy(header.magic, PROJECT_MAGIC, sizeof(header.magic));
+    header.version = PROJECT_VERSION;
+    header.chunkSize = TILE_CHUNK_SIZE;
+    header.canvasWidth = grid.getCanvasSize().x;
+    header.canvasHeight = grid.getCanvasSize().y;
+    header.tileWidth = grid.getTileSize().x;
+    header.tileHeight = grid.getTileSize().y;
+    header.selectedLayer = grid.getSelectedLayer();
+    header.layerCount = static_cast<uint32_t>(layerEntries.size());
+
+    FILE* file = std::fopen(tempPath.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    if (written && !layerEntries.empty())
+        written = std::fwrite(layerEntries.data(), sizeof(ProjectLayerEntry), layerEntries.size(), file) == layerEntries.size();
+    for (size_t i = 0; written && i < layerIndex.size(); ++i)
+    {
+        if (!layerIndex[i].empty())
+            written = std::fwrite(layerIndex[i].data(), sizeof(ProjectChunkEntry), layerIndex[i].size(), file) == layerIndex[i].size();
+    }
+
+    if (written && totalChunks != 0)
+        written = writeZeros(file, dataStart - indexEnd);
+    for (int number : numbers)
+    {
+        grid.findLayer(number)->forEachStoredChunk([&](int, int, const ImU32* cells) {
+            written = written && std::fwrite(cells, sizeof(ImU32), TILE_CHUNK_CELLS, file) == TILE_CHUNK_CELLS;
+        });
+    }
+
+    written = std::fclose(file) == 0 && written;
+    if (!written || !replaceFile(tempPath.c_str(), path))
+    {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool loadProject(const char* path, Grid& grid)
+{
+    TILE_TRACE_SCOPE("loadProject");
+    std::shared_ptr<const MappedFile> file = MappedFile::open(path);
+    if (file == nullptr)
+        return false;
+
+    ProjectHeader header;
+    if (!readRecord(*file, 0, header) || std::memcmp(header.magic, PROJECT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != PROJECT_VERSION || header.chunkSize != TILE_CHUNK_SIZE ||
+        !Grid::isValidSize(ImVec2(header.canvasWidth, header.canvasHeight), ImVec2(header.tileWidth, header.tileHeight)))
+        return false;
+
+    //A chunk outside the canvas fails the load, so a corrupt index cannot grow a huge chunk directory
+    const int chunkRows = Grid::canvasChunks(header.canvasHeight, header.tileHeight);
+    const int chunkCols = Grid::canvasChunks(header.canvasWidth, header.tileWidth);
+    Grid loaded(ImVec2(header.canvasWidth, header.canvasHeight), ImVec2(header.tileWidth, header.tileHeight));
+    std::vector<NumberedLayer> layers;
+    std::vector<MappedChunk> chunks;
+    for (uint32_t i = 0; i < header.layerCount; ++i)
+    {
+        ProjectLayerEntry entry;
+        if (!readRecord(*file, sizeof(ProjectHeader) + sizeof(ProjectLayerEntry) * static_cast<uint64_t>(i), entry))
+            return false;
+
+        chunks.clear();
+        for (uint32_t c = 0; c < entry.chunkCount; ++c)
+        {
+            ProjectChunkEntry chunk;
+            if (!readRecord(*file, entry.indexOffset + sizeof(ProjectChunkEntry) * static_cast<uint64_t>(c), chunk))
+                return false;
+            if (chunk.chunkRow < 0 || chunk.chunkCol < 0 || chunk.chunkRow >= chunkRows || chunk.chunkCol >= chunkCols ||
+                chunk.dataOffset % PROJECT_CHUNK_ALIGNMENT != 0 || chunk.dataOffset > file->size() || file->size() - chunk.dataOffset < PROJECT_CHUNK_BYTES)
+                return false;
+            chunks.push_back({ chunk.chunkRow, chunk.chunkCol, reinterpret_cast<const ImU32*>(file->data() + chunk.dataOffset) });
+        }
+
+        layers.push_back({ entry.number, TileLayer(entry.visible != 0) });
+        layers.back().layer.attachMapped(file, chunks);
+    }
+
+    //Repeated layer numbers fail here
+    if (!loaded.setLayers(std::move(layers), header.selectedLayer))
+        return false;
+    loaded.setChunkBudget(grid.getChunkBudget());
+    grid = std::move(loaded);
+    return true;
+}
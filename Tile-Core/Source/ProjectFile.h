@@ -0,0 +1,59 @@
+#pragma once
+#include "TileLayer.h"
+#include <cstdint>
+
+class Grid;
+
+//Binary project file. All fields are little-endian, as written by the x86/ARM hosts the editor runs on.
+//
+//  ProjectHeader
+//  ProjectLayerEntry[layerCount]                 in layer stack order, bottom first
+//  ProjectChunkEntry[chunkCount] per layer       at ProjectLayerEntry::indexOffset
+//  chunk cells, TILE_CHUNK_CELLS ImU32 each      at ProjectChunkEntry::dataOffset, PROJECT_CHUNK_ALIGNMENT aligned
+//
+//A chunk is exactly one 4 KiB page and starts on a page boundary, so opening a project only
+//reads the header and index tables: the cells stay in the mapping until a chunk is first touched.
+
+constexpr char PROJECT_MAGIC[8] = { 'T', 'I', 'L', 'E', 'P', 'R', 'J', '\0' };
+constexpr uint32_t PROJECT_VERSION = 1;
+constexpr uint64_t PROJECT_CHUNK_BYTES = sizeof(ImU32) * TILE_CHUNK_CELLS;
+constexpr uint64_t PROJECT_CHUNK_ALIGNMENT = 4096;
+
+struct ProjectHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t chunkSize;
+    float canvasWidth, canvasHeight;
+    float tileWidth, tileHeight;
+    int32_t selectedLayer;
+    uint32_t layerCount;
+};
+
+struct ProjectLayerEntry
+{
+    int32_t number;
+    uint32_t visible;
+    uint32_t chunkCount;
+    uint32_t reserved;
+    uint64_t indexOffset;
+};
+
+struct ProjectChunkEntry
+{
+    int32_t chunkRow, chunkCol;
+    uint64_t dataOffset;
+};
+
+static_assert(sizeof(ProjectHeader) == 40 && sizeof(ProjectLayerEntry) == 24 && sizeof(ProjectChunkEntry) == 16,
+    "project file records are written as is and must not contain padding");
+
+//Writes the map dimensions, layers and painted chunks of grid to path.tmp, then renames it over
+//path. On failure the file at path is left as it was. Layers still paging in from the file at path
+//are moved to the chunk store first, as the file is replaced.
+bool saveProject(Grid& grid, const char* path);
+
+//Maps the project at path and replaces grid with it, keeping its chunk budget. Chunks are paged in
+//lazily, the mapping stays open while any chunk is backed by it. A canvas Grid::isValidSize refuses
+//or a chunk outside the canvas fails the load. On failure grid is left untouched.
+bool loadProject(const char* path, Grid& grid);
@@ -0,0 +1,143 @@
+#include "Selection.h"
+#include "Grid.h"
+#include "Trace.h"
+#include <algorithm>
+#include <utility>
+
+void TileSelection::startFloating(Grid& grid, int row, int col)
+{
+    TILE_TRACE_SCOPE("TileSelection::startFloating");
+    //Closed by the drop, so the cells taken out and put back are undone together
+    grid.getHistory().begin();
+    m_floatLayer = TileLayer();
+    m_floatLayer.writeRect(0, 0, m_floatCells);
+    m_firstRow = row;
+    m_firstCol = col;
+    m_lastRow = row + m_floatCells.rows;
+    m_lastCol = col + m_floatCells.cols;
+    m_floating = true;
+}
+
+void TileSelection::stopFloating(Grid& grid)
+{
+    m_floating = false;
+    m_floatLayer = TileLayer();
+    m_floatCells = TileBuffer();
+    grid.getHistory().end();
+}
+
+void TileSelection::select(Grid& grid, int row0, int col0, int row1, int col1)
+{
+    drop(grid);
+    m_firstRow = std::max(std::min(row0, row1), 0);
+    m_firstCol = std::max(std::min(col0, col1), 0);
+    m_lastRow = std::min(std::max(row0, row1) + 1, grid.getRowCount());
+    m_lastCol = std::min(std::max(col0, col1) + 1, grid.getColumnCount());
+}
+
+void TileSelection::deselect(Grid& grid)
+{
+    drop(grid);
+    m_firstRow = m_firstCol = m_lastRow = m_lastCol = 0;
+}
+
+bool TileSelection::copy(Grid& grid)
+{
+    if (!hasSelection())
+        return false;
+
+    if (m_floating)
+        m_clipboard = m_floatCells;
+    else
+        grid.copyRegion(m_firstRow, m_firstCol, m_lastRow, m_lastCol, m_clipboard);
+    m_clipboardRow = m_firstRow;
+    m_clipboardCol = m_firstCol;
+    return true;
+}
+
+bool TileSelection::cut(Grid& grid)
+{
+    return copy(grid) && erase(grid);
+}
+
+bool TileSelection::paste(Grid& grid)
+{
+    if (!hasClipboard())
+        return false;
+
+    drop(grid);
+    m_floatCells = m_clipboard;
+    startFloating(grid, m_clipboardRow, m_clipboardCol);
+    return true;
+}
+
+bool TileSelection::erase(Grid& grid)
+{
+    if (!hasSelection())
+        return false;
+
+    if (m_floating)
+    {
+        //Lifted cells were already taken out of the layer, pasted ones were never written
+        stopFloating(grid);
+        m_firstRow = m_firstCol = m_lastRow = m_lastCol = 0;
+    }
+    else
+    {
+        grid.clearRegion(m_firstRow, m_firstCol, m_lastRow, m_lastCol);
+    }
+    return true;
+}
+
+bool TileSelection::lift(Grid& grid)
+{
+    if (!hasSelection() || m_floating)
+        return false;
+
+    TILE_TRACE_SCOPE("TileSelection::lift");
+    grid.copyRegion(m_firstRow, m_firstCol, m_lastRow, m_lastCol, m_floatCells);
+    startFloating(grid, m_firstRow, m_firstCol);
+    grid.clearRegion(m_firstRow, m_firstCol, m_lastRow, m_lastCol);
+    return true;
+}
+
+void TileSelection::moveBy(int rows, int cols)
+{
+    if (!m_floating)
+        return;
+
+    m_firstRow += rows;
+    m_lastRow += rows;
+    m_firstCol += cols;
+    m_lastCol += cols;
+}
+
+void TileSelection::drop(Grid& grid)
+{
+    if (!m_floating)
+        return;
+
+    TILE_TRACE_SCOPE("TileSelection::drop");
+    grid.pasteRegion(m_firstRow, m_firstCol, m_floatCells);
+    stopFloating(grid);
+    m_firstRow = std::max(m_firstRow, 0);
+    m_firstCol = std::max(m_firstCol, 0);
+    m_lastRow = std::min(m_lastRow, grid.getRowCount());
+    m_lastCol = std::min(m_lastCol, grid.getColumnCount());
+}
+
+void TileSelection::render(Grid& grid, ImDrawList* drawList)
+{
+    if (!hasSelection())
+        return;
+
+    if (m_floating)
+        grid.renderFloating(drawList, m_floatLayer, m_firstRow, m_firstCol);
+
+    ImVec2 canvasPos = ImGui::GetCursorScreenPos();
+    ImVec2 tileSize = grid.getTileSize();
+    ImVec2 min(canvasPos.x + m_firstCol * tileSize.x, canvasPos.y + m_firstRow * tileSize.y);
+    ImVec2 max(canvasPos.x + m_lastCol * tileSize.x, canvasPos.y + m_lastRow * tileSize.y);
+    drawList->AddRect(min, max, IM_COL32(0, 0, 0, 255), 0.0f, 0, 3.0f);
+    drawList->AddRect(min, max, IM_COL32(255, 255, 255, 255), 0.0f, 0, 1.0f);
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <imgui.h>
+#include "TileLayer.h"
+
+class Grid;
+
+//Rectangular selection of tiles of the selected layer, with copy, cut, paste and move.
+//Cells are moved around as contiguous TileBuffers, read and written a chunk row segment at a time.
+//Lifted or pasted cells float above the layer until they are dropped. They are kept in a layer of
+//their own, so dragging them only changes where its cached chunk quads are drawn, however many
+//tiles they hold. A lift and the drop that ends it are one undo step.
+class TileSelection
+{
+private:
+    //Selected cells [m_firstRow, m_lastRow) x [m_firstCol, m_lastCol), in tiles. Empty when nothing is
+    //selected. While floating it is the rectangle of the floating cells, which may leave the canvas.
+    int m_firstRow = 0;
+    int m_firstCol = 0;
+    int m_lastRow = 0;
+    int m_lastCol = 0;
+
+    TileBuffer m_clipboard;
+    //Where the clipboard cells were copied from, pasted back there
+    int m_clipboardRow = 0;
+    int m_clipboardCol = 0;
+
+    bool m_floating = false;
+    TileBuffer m_floatCells;
+    TileLayer m_floatLayer;
+
+    void startFloating(Grid& grid, int row, int col);
+    void stopFloating(Grid& grid);
+
+public:
+    //Selects the rectangle with the two cells as opposite corners, clamped to the canvas.
+    //Floating cells are dropped first.
+    void select(Grid& grid, int row0, int col0, int row1, int col1);
+
+    //Drops floating cells and selects nothing
+    void deselect(Grid& grid);
+
+    bool hasSelection() const
+    {
+        return m_firstRow < m_lastRow && m_firstCol < m_lastCol;
+    }
+
+    bool isFloating() const
+    {
+        return m_floating;
+    }
+
+    bool hasClipboard() const
+    {
+        return !m_clipboard.cells.empty();
+    }
+
+    const TileBuffer& getClipboard() const
+    {
+        return m_clipboard;
+    }
+
+    bool contains(int row, int col) const
+    {
+        return row >= m_firstRow && row < m_lastRow && col >= m_firstCol && col < m_lastCol;
+    }
+
+    //Copies the selected or floating cells to the clipboard
+    bool copy(Grid& grid);
+
+    //Copies the selected or floating cells to the clipboard and removes them
+    bool cut(Grid& grid);
+
+    //Floats the clipboard cells where they were copied from. Floating cells are dropped first.
+    bool paste(Grid& grid);
+
+    //Empties the selected cells, or throws the floating ones away
+    bool erase(Grid& grid);
+
+    //Takes the selected cells out of the layer to move them
+    bool lift(Grid& grid);
+
+    void moveBy(int rows, int cols);
+
+    //Writes the floating cells into the selected layer where they are, clipped to the canvas
+    void drop(Grid& grid);
+
+    //Draws the floating cells and the selection outline at the current ImGui cursor position
+    void render(Grid& grid, ImDrawList* drawList);
+};
@@ -0,0 +1,142 @@
+#include "Shape.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+
+namespace
+{
+    struct RowExtent
+    {
+        int firstCol, lastCol;
+    };
+
+    //Outline of a shape given by the filled extent of each of its rows: the cells of a row that
+    //are not surrounded on all four sides, at most two spans
+    void appendOutline(const std::vector<RowExtent>& extents, int firstRow, std::vector<TileSpan>& spans)
+    {
+        const int rows = static_cast<int>(extents.size());
+        for (int i = 0; i < rows; ++i)
+        {
+            const RowExtent& extent = extents[i];
+            int row = firstRow + i;
+            if (i == 0 || i == rows - 1)
+            {
+                spans.push_back({ row, extent.firstCol, extent.lastCol });
+                continue;
+            }
+
+            int innerFirst = std::max({ extent.firstCol + 1, extents[i - 1].firstCol, extents[i + 1].firstCol });
+            int innerLast = std::min({ extent.lastCol - 1, extents[i - 1].lastCol, extents[i + 1].lastCol });
+            if (innerFirst >= innerLast)
+            {
+                spans.push_back({ row, extent.firstCol, extent.lastCol });
+                continue;
+            }
+            spans.push_back({ row, extent.firstCol, innerFirst });
+            spans.push_back({ row, innerLast, extent.lastCol });
+        }
+    }
+
+    //Filled extent of every row of the ellipse inscribed in the box: the cells whose centre is inside
+    std::vector<RowExtent> ellipseExtents(int firstRow, int firstCol, int lastRow, int lastCol)
+    {
+        const double radiusY = (lastRow - firstRow) / 2.0;
+        const double radiusX = (lastCol - firstCol) / 2.0;
+        const double centerX = firstCol + radiusX;
+        std::vector<RowExtent> extents(lastRow - firstRow);
+        for (int i = 0; i < lastRow - firstRow; ++i)
+        {
+            double dy = (i + 0.5 - radiusY) / radiusY;
+            double halfWidth = radiusX * std::sqrt(std::max(0.0, 1.0 - dy * dy));
+            int first = static_cast<int>(std::ceil(centerX - halfWidth - 0.5));
+            int last = static_cast<int>(std::floor(centerX + halfWidth - 0.5)) + 1;
+            //Rows whose cell centres all miss a thin ellipse keep the middle cell, so the outline stays closed
+            if (first >= last)
+            {
+                first = static_cast<int>(std::floor(centerX - 0.5));
+                first = std::min(std::max(first, firstCol), lastCol - 1);
+                last = first + 1;
+            }
+            extents[i] = { first, last };
+        }
+        return extents;
+    }
+
+    //Bresenham line, consecutive cells of a row merged into one span
+    void appendLine(int row0, int col0, int row1, int col1, std::vector<TileSpan>& spans)
+    {
+        int dRow = std::abs(row1 - row0);
+        int dCol = std::abs(col1 - col0);
+        int stepRow = row0 < row1 ? 1 : -1;
+        int stepCol = col0 < col1 ? 1 : -1;
+        int error = dCol - dRow;
+        int row = row0;
+        int col = col0;
+        int spanStart = col;
+        while (true)
+        {
+            bool done = row == row1 && col == col1;
+            int nextRow = row;
+            int nextCol = col;
+            if (!done)
+            {
+                int twice = 2 * error;
+                if (twice > -dRow)
+                {
+                    error -= dRow;
+                    nextCol += stepCol;
+                }
+                if (twice < dCol)
+                {
+                    error += dCol;
+                    nextRow += stepRow;
+                }
+            }
+            if (done || nextRow != row)
+            {
+                spans.push_back({ row, std::min(spanStart, col), std::max(spanStart, col) + 1 });
+                spanStart = nextCol;
+            }
+            if (done)
+                break;
+            row = nextRow;
+            col = nextCol;
+        }
+        //Lines drawn upwards are emitted bottom row first
+        if (stepRow < 0)
+            std::reverse(spans.begin(), spans.end());
+    }
+}
+
+void rasterizeShape(ShapeKind kind, int row0, int col0, int row1, int col1, std::vector<TileSpan>& spans)
+{
+    spans.clear();
+    if (kind == ShapeKind::Line)
+    {
+        appendLine(row0, col0, row1, col1, spans);
+        return;
+    }
+
+    //Box with exclusive last row and column
+    const int firstRow = std::min(row0, row1);
+    const int lastRow = std::max(row0, row1) + 1;
+    const int firstCol = std::min(col0, col1);
+    const int lastCol = std::max(col0, col1) + 1;
+    std::vector<RowExtent> extents;
+    if (kind == ShapeKind::Rectangle || kind == ShapeKind::FilledRectangle)
+        extents.assign(lastRow - firstRow, { firstCol, lastCol });
+    else
+        extents = ellipseExtents(firstRow, firstCol, lastRow, lastCol);
+
+    if (kind == ShapeKind::FilledRectangle || kind == ShapeKind::FilledEllipse)
+    {
+        spans.reserve(extents.size());
+        for (int i = 0; i < static_cast<int>(extents.size()); ++i)
+            spans.push_back({ firstRow + i, extents[i].firstCol, extents[i].lastCol });
+    }
+    else
+    {
+        appendOutline(extents, firstRow, spans);
+    }
+}
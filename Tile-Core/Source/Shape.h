@@ -0,0 +1,18 @@
+#pragma once
+#include "TileLayer.h"
+#include <vector>
+
+//Shapes drawn by dragging from one cell to another. Rectangles and ellipses fit the box with
+//the two cells as opposite corners, a line joins them.
+enum class ShapeKind
+{
+    Rectangle,
+    FilledRectangle,
+    Ellipse,
+    FilledEllipse,
+    Line,
+};
+
+//Rasterizes a shape into row spans, replacing the contents of spans. Rows are in increasing
+//order and the spans of a row do not overlap, so every cell of the shape is written once.
+void rasterizeShape(ShapeKind kind, int row0, int col0, int row1, int col1, std::vector<TileSpan>& spans);
@@ -0,0 +1,531 @@
+#include "TileHistory.h"
+#include "Grid.h"
+#include "MappedFile.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+    enum RecordKind : uint8_t
+    {
+        //Rest of the block is unused, the next record starts in the next block
+        RECORD_PAD,
+        RECORD_SPAN,
+        RECORD_ADD_LAYER,
+        RECORD_DELETE_LAYER,
+        RECORD_CHUNK_MASK,
+        RECORD_MOVE_LAYER,
+    };
+
+    enum SpanFlags : uint8_t
+    {
+        SPAN_OLD_UNIFORM = 1,
+        SPAN_NEW_UNIFORM = 2,
+    };
+
+    //Followed by the old then the new colours of a span, one each when uniform,
+    //by the selected layer after the change and the stack index of the layer for add and delete
+    //records, or for a chunk mask by TILE_CHUNK_SIZE row masks, the old cells (one when uniform,
+    //else the whole chunk) and the new colour. Move records have no payload.
+    struct RecordHeader
+    {
+        uint8_t kind;
+        uint8_t flags;
+        uint8_t row;
+        uint8_t firstCol;
+        uint8_t lastCol;
+        uint8_t reserved[3];
+        int32_t layer;
+        //Chunk of a span or mask; stash id and selected layer before the change of an add or delete
+        //record; stack indices before and after a move
+        int32_t a, b;
+    };
+    static_assert(sizeof(RecordHeader) == 20, "history records are packed in the arena");
+
+    size_t recordBytes(const RecordHeader& header)
+    {
+        if (header.kind == RECORD_CHUNK_MASK)
+            return sizeof(RecordHeader) + sizeof(uint32_t) * TILE_CHUNK_SIZE + sizeof(ImU32) * ((header.flags & SPAN_OLD_UNIFORM ? 1 : TILE_CHUNK_CELLS) + 1);
+        if (header.kind == RECORD_MOVE_LAYER)
+            return sizeof(RecordHeader);
+        if (header.kind != RECORD_SPAN)
+            return sizeof(RecordHeader) + 2 * sizeof(int32_t);
+        size_t count = header.lastCol - header.firstCol;
+        return sizeof(RecordHeader) + sizeof(ImU32) * ((header.flags & SPAN_OLD_UNIFORM ? 1 : count) + (header.flags & SPAN_NEW_UNIFORM ? 1 : count));
+    }
+
+    RecordHeader readHeader(const unsigned char* record)
+    {
+        RecordHeader header;
+        std::memcpy(&header, record, sizeof(header));
+        return header;
+    }
+}
+
+unsigned char* TileHistory::at(uint64_t position)
+{
+    uint64_t offset = position - m_base;
+    return m_blocks[static_cast<size_t>(offset / BLOCK_BYTES)].get() + offset % BLOCK_BYTES;
+}
+
+unsigned char* TileHistory::allocate(size_t bytes)
+{
+    uint64_t offset = m_top % BLOCK_BYTES;
+    if (offset + bytes > BLOCK_BYTES)
+    {
+        *at(m_top) = RECORD_PAD;
+        m_top += BLOCK_BYTES - offset;
+    }
+    while ((m_top - m_base) / BLOCK_BYTES >= m_blocks.size())
+    {
+        m_blocks.push_back(std::make_unique<unsigned char[]>(BLOCK_BYTES));
+        m_memoryBytes += BLOCK_BYTES;
+    }
+    unsigned char* record = at(m_top);
+    m_top += bytes;
+    return record;
+}
+
+std::vector<uint64_t> TileHistory::recordsOf(const Transaction& transaction)
+{
+    std::vector<uint64_t> records;
+    uint64_t position = transaction.begin;
+    while (position < transaction.end)
+    {
+        uint64_t left = BLOCK_BYTES - position % BLOCK_BYTES;
+        if (left < sizeof(RecordHeader) || *at(position) == RECORD_PAD)
+        {
+            position += left;
+            continue;
+        }
+        records.push_back(position);
+        position += recordBytes(readHeader(at(position)));
+    }
+    return records;
+}
+
+void TileHistory::stash(uint32_t id, TileLayer layer)
+{
+    size_t bytes = layer.getAllocatedChunkCount() * sizeof(TileChunk);
+    m_memoryBytes += bytes;
+    m_stash.emplace(id, StashedLayer{ std::move(layer), bytes });
+}
+
+void TileHistory::detachMapped(const std::string& path, const std::shared_ptr<ChunkStore>& store)
+{
+    for (auto& stashed : m_stash)
+    {
+        const MappedFile* file = stashed.second.layer.getMappedFile();
+        if (file != nullptr && file->getPath() == path)
+            stashed.second.layer.detachMapped(store);
+    }
+}
+
+TileLayer TileHistory::unstash(uint32_t id)
+{
+    //An added layer is only stashed while its addition is undone
+    auto it = m_stash.find(id);
+    if (it == m_stash.end())
+        return TileLayer();
+    m_memoryBytes -= it->second.bytes;
+    TileLayer layer = std::move(it->second.layer);
+    m_stash.erase(it);
+    return layer;
+}
+
+TileHistory::Transaction& TileHistory::current()
+{
+    if (!m_open)
+    {
+        discardRedo();
+        m_transactions.push_back({ m_top, m_top, {} });
+        m_applied = m_transactions.size();
+        m_open = true;
+    }
+    return m_transactions.back();
+}
+
+void TileHistory::begin()
+{
+    ++m_depth;
+}
+
+void TileHistory::end()
+{
+    if (m_depth == 0 || --m_depth != 0 || !m_open)
+        return;
+    m_transactions.back().end = m_top;
+    m_open = false;
+    enforceCap();
+}
+
+void TileHistory::discardRedo()
+{
+    if (m_applied == m_transactions.size())
+        return;
+
+    m_top = m_transactions[m_applied].begin;
+    while (m_transactions.size() > m_applied)
+    {
+        for (uint32_t id : m_transactions.back().stashIds)
+            unstash(id);
+        m_transactions.pop_back();
+    }
+
+    //Keeps the block holding the top, later records go there
+    size_t usedBlocks = static_cast<size_t>((m_top - m_base + BLOCK_BYTES - 1) / BLOCK_BYTES);
+    while (m_blocks.size() > usedBlocks)
+    {
+        m_blocks.pop_back();
+        m_memoryBytes -= BLOCK_BYTES;
+    }
+}
+
+void TileHistory::dropOldest()
+{
+    //Redo transactions depend on every one before them, without undo history they all go
+    if (m_applied == 0)
+    {
+        clear();
+        return;
+    }
+
+    for (uint32_t id : m_transactions.front().stashIds)
+        unstash(id);
+    m_transactions.pop_front();
+    --m_applied;
+
+    uint64_t first = m_transactions.empty() ? m_top : m_transactions.front().begin;
+    while (!m_blocks.empty() && m_base + BLOCK_BYTES <= first)
+    {
+        m_blocks.pop_front();
+        m_base += BLOCK_BYTES;
+        m_memoryBytes -= BLOCK_BYTES;
+    }
+}
+
+void TileHistory::enforceCap()
+{
+    while (m_memoryBytes > m_memoryCap && !m_transactions.empty() && !m_open)
+        dropOldest();
+}
+
+void TileHistory::clear()
+{
+    m_blocks.clear();
+    m_transactions.clear();
+    m_stash.clear();
+    m_base = 0;
+    m_top = 0;
+    m_applied = 0;
+    m_open = false;
+    m_memoryBytes = 0;
+}
+
+void TileHistory::recordSpan(int layerNumber, int chunkRow, int chunkCol, int row, int firstCol, int lastCol, const ImU32* oldCells, const ImU32* newCells, ImU32 color)
+{
+    current();
+    int count = lastCol - firstCol;
+    bool oldUniform = oldCells == nullptr || std::all_of(oldCells + 1, oldCells + count, [&](ImU32 cell) { return cell == oldCells[0]; });
+    bool newUniform = newCells == nullptr || std::all_of(newCells + 1, newCells + count, [&](ImU32 cell) { return cell == newCells[0]; });
+
+    RecordHeader header = {};
+    header.kind = RECORD_SPAN;
+    header.flags = (newUniform ? SPAN_NEW_UNIFORM : 0) | (oldUniform ? SPAN_OLD_UNIFORM : 0);
+    header.row = static_cast<uint8_t>(row);
+    header.firstCol = static_cast<uint8_t>(firstCol);
+    header.lastCol = static_cast<uint8_t>(lastCol);
+    header.layer = layerNumber;
+    header.a = chunkRow;
+    header.b = chunkCol;
+
+    unsigned char* record = allocate(recordBytes(header));
+    std::memcpy(record, &header, sizeof(header));
+    unsigned char* colors = record + sizeof(header);
+    if (oldCells == nullptr)
+    {
+        const ImU32 empty = IM_COL32_BLACK_TRANS;
+        std::memcpy(colors, &empty, sizeof(ImU32));
+    }
+    else
+    {
+        std::memcpy(colors, oldCells, sizeof(ImU32) * (oldUniform ? 1 : count));
+    }
+    colors += sizeof(ImU32) * (oldUniform ? 1 : count);
+    std::memcpy(colors, newCells != nullptr ? newCells : &color, sizeof(ImU32) * (newUniform ? 1 : count));
+}
+
+void TileHistory::recordLayer(uint8_t kind, int layerNumber, int index, uint32_t stashId, int selectedBefore, int selectedAfter)
+{
+    current().stashIds.push_back(stashId);
+
+    RecordHeader header = {};
+    header.kind = kind;
+    header.layer = layerNumber;
+    header.a = static_cast<int32_t>(stashId);
+    header.b = selectedBefore;
+
+    unsigned char* record = allocate(recordBytes(header));
+    std::memcpy(record, &header, sizeof(header));
+    int32_t payload[2] = { selectedAfter, index };
+    std::memcpy(record + sizeof(header), payload, sizeof(payload));
+}
+
+void TileHistory::recordFill(int layerNumber, const TileLayer& layer, int firstRow, int firstCol, int lastRow, int lastCol, ImU32 color)
+{
+    firstRow = std::max(firstRow, 0);
+    firstCol = std::max(firstCol, 0);
+    if (firstRow >= lastRow || firstCol >= lastCol)
+        return;
+
+    begin();
+    for (int chunkRow = firstRow / TILE_CHUNK_SIZE; chunkRow <= (lastRow - 1) / TILE_CHUNK_SIZE; ++chunkRow)
+    {
+        for (int chunkCol = firstCol / TILE_CHUNK_SIZE; chunkCol <= (lastCol - 1) / TILE_CHUNK_SIZE; ++chunkCol)
+        {
+            const TileChunk* chunk = layer.findChunk(chunkRow, chunkCol);
+            if (chunk == nullptr && color == IM_COL32_BLACK_TRANS)
+                continue;
+
+            int baseRow = chunkRow * TILE_CHUNK_SIZE;
+            int baseCol = chunkCol * TILE_CHUNK_SIZE;
+            int spanFirst = std::max(firstCol - baseCol, 0);
+            int spanLast = std::min(lastCol - baseCol, TILE_CHUNK_SIZE);
+            for (int row = std::max(firstRow - baseRow, 0); row < std::min(lastRow - baseRow, TILE_CHUNK_SIZE); ++row)
+            {
+                const ImU32* oldCells = chunk != nullptr ? &chunk->cells[row * TILE_CHUNK_SIZE + spanFirst] : nullptr;
+                if (chunk != nullptr && chunk->spanHasColor(row, spanFirst, spanLast, color))
+                    continue;
+                recordSpan(layerNumber, chunkRow, chunkCol, row, spanFirst, spanLast, oldCells, nullptr, color);
+            }
+        }
+    }
+    end();
+}
+
+void TileHistory::recordWrite(int layerNumber, const TileLayer& layer, int firstRow, int firstCol, const TileBuffer& buffer)
+{
+    const int lastRow = firstRow + buffer.rows;
+    const int lastCol = firstCol + buffer.cols;
+    if (firstRow < 0 || firstCol < 0 || buffer.rows <= 0 || buffer.cols <= 0)
+        return;
+
+    begin();
+    for (int chunkRow = firstRow / TILE_CHUNK_SIZE; chunkRow <= (lastRow - 1) / TILE_CHUNK_SIZE; ++chunkRow)
+    {
+        for (int chunkCol = firstCol / TILE_CHUNK_SIZE; chunkCol <= (lastCol - 1) / TILE_CHUNK_SIZE; ++chunkCol)
+        {
+            const TileChunk* chunk = layer.findChunk(chunkRow, chunkCol);
+            int baseRow = chunkRow * TILE_CHUNK_SIZE;
+            int baseCol = chunkCol * TILE_CHUNK_SIZE;
+            int spanFirst = std::max(firstCol - baseCol, 0);
+            int spanLast = std::min(lastCol - baseCol, TILE_CHUNK_SIZE);
+            for (int row = std::max(firstRow - baseRow, 0); row < std::min(lastRow - baseRow, TILE_CHUNK_SIZE); ++row)
+            {
+                const ImU32* newCells = buffer.row(baseRow + row - firstRow) + baseCol + spanFirst - firstCol;
+                const ImU32* oldCells = chunk != nullptr ? &chunk->cells[row * TILE_CHUNK_SIZE + spanFirst] : nullptr;
+                if (chunk != nullptr ? std::equal(newCells, newCells + spanLast - spanFirst, oldCells) :
+                    std::all_of(newCells, newCells + spanLast - spanFirst, [](ImU32 cell) { return cell == IM_COL32_BLACK_TRANS; }))
+                    continue;
+                recordSpan(layerNumber, chunkRow, chunkCol, row, spanFirst, spanLast, oldCells, newCells, IM_COL32_BLACK_TRANS);
+            }
+        }
+    }
+    end();
+}
+
+void TileHistory::recordSpans(int layerNumber, const TileLayer& layer, const std::vector<TileSpan>& spans, ImU32 color)
+{
+    begin();
+    for (const TileSpan& span : spans)
+        recordFill(layerNumber, layer, span.row, span.firstCol, span.row + 1, span.lastCol, color);
+    end();
+}
+
+void TileHistory::recordFillMasked(int layerNumber, const TileLayer& layer, int chunkRow, int chunkCol, const uint32_t* rowMasks, ImU32 color)
+{
+    const TileChunk* chunk = layer.findChunk(chunkRow, chunkCol);
+    if (chunk == nullptr && color == IM_COL32_BLACK_TRANS)
+        return;
+
+    //Old cells are uniform when the masked cells are all empty, or all hold the colour of the first one
+    bool oldUniform = true;
+    ImU32 oldColor = IM_COL32_BLACK_TRANS;
+    if (chunk != nullptr)
+    {
+        bool anyPainted = false;
+        for (int row = 0; row < TILE_CHUNK_SIZE; ++row)
+            anyPainted |= (chunk->occupancy[row] & rowMasks[row]) != 0;
+        if (anyPainted)
+        {
+            int firstRow = 0;
+            while (rowMasks[firstRow] == 0)
+                ++firstRow;
+            oldColor = chunk->cells[firstRow * TILE_CHUNK_SIZE + lowestSetBit(rowMasks[firstRow])];
+            for (int row = firstRow; row < TILE_CHUNK_SIZE && oldUniform; ++row)
+                oldUniform = (tileRowMatch(&chunk->cells[row * TILE_CHUNK_SIZE], oldColor) & rowMasks[row]) == rowMasks[row];
+        }
+    }
+    if (oldUniform && oldColor == color)
+        return;
+
+    begin();
+    current();
+    RecordHeader header = {};
+    header.kind = RECORD_CHUNK_MASK;
+    header.flags = oldUniform ? SPAN_OLD_UNIFORM : 0;
+    header.layer = layerNumber;
+    header.a = chunkRow;
+    header.b = chunkCol;
+
+    unsigned char* record = allocate(recordBytes(header));
+    std::memcpy(record, &header, sizeof(header));
+    unsigned char* payload = record + sizeof(header);
+    std::memcpy(payload, rowMasks, sizeof(uint32_t) * TILE_CHUNK_SIZE);
+    payload += sizeof(uint32_t) * TILE_CHUNK_SIZE;
+    if (oldUniform)
+    {
+        std::memcpy(payload, &oldColor, sizeof(ImU32));
+        payload += sizeof(ImU32);
+    }
+    else
+    {
+        std::memcpy(payload, chunk->cells.data(), sizeof(ImU32) * TILE_CHUNK_CELLS);
+        payload += sizeof(ImU32) * TILE_CHUNK_CELLS;
+    }
+    std::memcpy(payload, &color, sizeof(ImU32));
+    end();
+}
+
+void TileHistory::recordAddLayer(int layerNumber, int index, int selectedBefore)
+{
+    begin();
+    recordLayer(RECORD_ADD_LAYER, layerNumber, index, m_nextStashId++, selectedBefore, layerNumber);
+    end();
+}
+
+void TileHistory::recordDeleteLayer(int layerNumber, int index, TileLayer layer, int selectedBefore, int selectedAfter)
+{
+    begin();
+    uint32_t id = m_nextStashId++;
+    recordLayer(RECORD_DELETE_LAYER, layerNumber, index, id, selectedBefore, selectedAfter);
+    stash(id, std::move(layer));
+    end();
+}
+
+void TileHistory::recordMoveLayer(int layerNumber, int from, int to)
+{
+    begin();
+    current();
+    RecordHeader header = {};
+    header.kind = RECORD_MOVE_LAYER;
+    header.layer = layerNumber;
+    header.a = from;
+    header.b = to;
+    std::memcpy(allocate(recordBytes(header)), &header, sizeof(header));
+    end();
+}
+
+void TileHistory::applyRecord(Grid& grid, const unsigned char* record, bool undo)
+{
+    RecordHeader header = readHeader(record);
+    const unsigned char* payload = record + sizeof(header);
+    if (header.kind == RECORD_CHUNK_MASK)
+    {
+        TileLayer* layer = grid.findLayer(header.layer);
+        if (layer == nullptr)
+            return;
+
+        uint32_t rowMasks[TILE_CHUNK_SIZE];
+        std::memcpy(rowMasks, payload, sizeof(rowMasks));
+        payload += sizeof(rowMasks);
+        bool oldUniform = (header.flags & SPAN_OLD_UNIFORM) != 0;
+        if (undo && !oldUniform)
+        {
+            std::vector<ImU32> cells(TILE_CHUNK_CELLS);
+            std::memcpy(cells.data(), payload, sizeof(ImU32) * TILE_CHUNK_CELLS);
+            layer->writeChunkMasked(header.a, header.b, rowMasks, cells.data());
+            return;
+        }
+
+        if (!undo)
+            payload += sizeof(ImU32) * (oldUniform ? 1 : TILE_CHUNK_CELLS);
+        ImU32 color;
+        std::memcpy(&color, payload, sizeof(color));
+        layer->fillChunkMasked(header.a, header.b, rowMasks, color);
+        return;
+    }
+
+    if (header.kind == RECORD_SPAN)
+    {
+        TileLayer* layer = grid.findLayer(header.layer);
+        if (layer == nullptr)
+            return;
+
+        int count = header.lastCol - header.firstCol;
+        bool uniform = (header.flags & (undo ? SPAN_OLD_UNIFORM : SPAN_NEW_UNIFORM)) != 0;
+        if (!undo)
+            payload += sizeof(ImU32) * (header.flags & SPAN_OLD_UNIFORM ? 1 : count);
+
+        if (uniform)
+        {
+            ImU32 color;
+            std::memcpy(&color, payload, sizeof(color));
+            layer->fillChunkSpan(header.a, header.b, header.row, header.firstCol, header.lastCol, color);
+        }
+        else
+        {
+            ImU32 colors[TILE_CHUNK_SIZE];
+            std::memcpy(colors, payload, sizeof(ImU32) * count);
+            layer->writeChunkSpan(header.a, header.b, header.row, header.firstCol, header.lastCol, colors);
+        }
+        return;
+    }
+
+    if (header.kind == RECORD_MOVE_LAYER)
+    {
+        grid.placeLayer(header.layer, undo ? header.a : header.b);
+        return;
+    }
+
+    int32_t selectedAfter, index;
+    std::memcpy(&selectedAfter, payload, sizeof(selectedAfter));
+    std::memcpy(&index, payload + sizeof(selectedAfter), sizeof(index));
+    uint32_t id = static_cast<uint32_t>(header.a);
+    //Undoing an add or redoing a delete takes the layer out of the grid, the reverse puts it back
+    //where it was in the stack
+    if ((header.kind == RECORD_ADD_LAYER) == undo)
+        stash(id, grid.removeLayer(header.layer));
+    else
+        grid.insertLayer(header.layer, index, unstash(id));
+    grid.selectLayer(undo ? header.b : selectedAfter);
+}
+
+bool TileHistory::undo(Grid& grid)
+{
+    if (!canUndo())
+        return false;
+    TILE_TRACE_SCOPE("TileHistory::undo");
+
+    const Transaction& transaction = m_transactions[--m_applied];
+    std::vector<uint64_t> records = recordsOf(transaction);
+    for (auto it = records.rbegin(); it != records.rend(); ++it)
+        applyRecord(grid, at(*it), true);
+    enforceCap();
+    return true;
+}
+
+bool TileHistory::redo(Grid& grid)
+{
+    if (!canRedo())
+        return false;
+    TILE_TRACE_SCOPE("TileHistory::redo");
+
+    const Transaction& transaction = m_transactions[m_applied++];
+    for (uint64_t position : recordsOf(transaction))
+        applyRecord(grid, at(position), false);
+    enforceCap();
+    return true;
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include "TileLayer.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Grid;
+
+//Undo/redo journal. A transaction (one stroke, one layer add, delete or move) is a run of records in an
+//arena of fixed-size blocks; transactions are contiguous and ordered, so dropping the oldest frees
+//whole blocks and discarding the redo branch just moves the arena top back.
+//Painting is recorded per chunk row span: the old cells of the span and the new ones, each
+//stored once when uniform. A 100k tile fill is a few thousand span records, and undoing it writes
+//those spans back, a memcpy per chunk row. Bucket fills are recorded per chunk, as the bitmask of
+//filled cells with the old cells.
+//Deleted layers, and added layers once undone, are kept whole in a stash until their transaction
+//is dropped. Beyond the memory cap the oldest transactions are dropped.
+class TileHistory
+{
+public:
+    static constexpr size_t BLOCK_BYTES = 64 * 1024;
+
+private:
+    struct Transaction
+    {
+        uint64_t begin, end;
+        //Stashed layers the records refer to, freed with the transaction
+        std::vector<uint32_t> stashIds;
+    };
+
+    struct StashedLayer
+    {
+        TileLayer layer;
+        //Resident chunk bytes, counted against the memory cap
+        size_t bytes;
+    };
+
+    std::deque<std::unique_ptr<unsigned char[]>> m_blocks;
+    //Arena position of the first byte of m_blocks.front()
+    uint64_t m_base = 0;
+    uint64_t m_top = 0;
+
+    std::deque<Transaction> m_transactions;
+    //Transactions [0, m_applied) can be undone, [m_applied, size) redone
+    size_t m_applied = 0;
+    //A transaction has been started by a record inside the current begin/end
+    bool m_open = false;
+    int m_depth = 0;
+
+    std::unordered_map<uint32_t, StashedLayer> m_stash;
+    uint32_t m_nextStashId = 0;
+
+    size_t m_memoryCap = 64 << 20;
+    size_t m_memoryBytes = 0;
+
+    unsigned char* allocate(size_t bytes);
+    unsigned char* at(uint64_t position);
+    void discardRedo();
+    void enforceCap();
+    void dropOldest();
+    Transaction& current();
+    //newCells, or color when it is nullptr, are the cells after the change
+    void recordSpan(int layerNumber, int chunkRow, int chunkCol, int row, int firstCol, int lastCol, const ImU32* oldCells, const ImU32* newCells, ImU32 color);
+    void recordLayer(uint8_t kind, int layerNumber, int index, uint32_t stashId, int selectedBefore, int selectedAfter);
+    void stash(uint32_t id, TileLayer layer);
+    TileLayer unstash(uint32_t id);
+    void applyRecord(Grid& grid, const unsigned char* record, bool undo);
+    //Arena positions of the records of a transaction in order
+    std::vector<uint64_t> recordsOf(const Transaction& transaction);
+
+public:
+    //Nested begin/end pairs form one transaction. Records made outside of any are a transaction each.
+    void begin();
+    void end();
+
+    //Records the old cells of [firstRow, lastRow) x [firstCol, lastCol) of a layer about to be
+    //filled with color. Spans that already hold color are skipped.
+    void recordFill(int layerNumber, const TileLayer& layer, int firstRow, int firstCol, int lastRow, int lastCol, ImU32 color);
+
+    //Records the old cells of the rectangle at (firstRow, firstCol) about to be replaced by buffer
+    void recordWrite(int layerNumber, const TileLayer& layer, int firstRow, int firstCol, const TileBuffer& buffer);
+
+    //Records the old cells of spans about to be filled with color
+    void recordSpans(int layerNumber, const TileLayer& layer, const std::vector<TileSpan>& spans, ImU32 color);
+
+    //Records the old cells of a chunk about to have the cells set in rowMasks filled with color
+    void recordFillMasked(int layerNumber, const TileLayer& layer, int chunkRow, int chunkCol, const uint32_t* rowMasks, ImU32 color);
+
+    //Records a layer added to the grid, and a layer removed from it which the history keeps, with
+    //the stack index it is put back at
+    void recordAddLayer(int layerNumber, int index, int selectedBefore);
+    void recordDeleteLayer(int layerNumber, int index, TileLayer layer, int selectedBefore, int selectedAfter);
+
+    //Records a layer moved between two stack indices
+    void recordMoveLayer(int layerNumber, int from, int to);
+
+    bool canUndo() const
+    {
+        return m_applied != 0 && !m_open;
+    }
+
+    bool canRedo() const
+    {
+        return m_applied < m_transactions.size() && !m_open;
+    }
+
+    bool undo(Grid& grid);
+    bool redo(Grid& grid);
+
+    void clear();
+
+    //Moves the chunks of stashed layers still paging in from the file at path into store, as
+    //Grid::detachLayersFrom does for the layers of the grid
+    void detachMapped(const std::string& path, const std::shared_ptr<ChunkStore>& store);
+
+    void setMemoryCap(size_t bytes)
+    {
+        m_memoryCap = bytes;
+        enforceCap();
+    }
+
+    size_t getMemoryCap() const
+    {
+        return m_memoryCap;
+    }
+
+    size_t getMemoryBytes() const
+    {
+        return m_memoryBytes;
+    }
+
+    size_t getUndoCount() const
+    {
+        return m_applied;
+    }
+};
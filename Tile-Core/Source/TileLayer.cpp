@@ -0,0 +1,514 @@
+#include "TileLayer.h"
+#include "ChunkStore.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+const std::vector<TileQuad>& TileChunk::getQuads() const
+{
+    if (quadsDirty)
+    {
+        quads.clear();
+        std::array<uint32_t, TILE_CHUNK_SIZE> remaining = occupancy;
+        for (int row = 0; row < TILE_CHUNK_SIZE; ++row)
+        {
+            while (remaining[row] != 0)
+            {
+                int firstCol = lowestSetBit(remaining[row]);
+                const ImU32 color = cells[row * TILE_CHUNK_SIZE + firstCol];
+
+                int lastCol = firstCol + 1;
+                while (lastCol < TILE_CHUNK_SIZE && (remaining[row] & (1u << lastCol)) != 0 && cells[row * TILE_CHUNK_SIZE + lastCol] == color)
+                    ++lastCol;
+                uint32_t span = tileSpanMask(firstCol, lastCol);
+
+                int lastRow = row + 1;
+                while (lastRow < TILE_CHUNK_SIZE && (remaining[lastRow] & span) == span && spanHasColor(lastRow, firstCol, lastCol, color))
+                    ++lastRow;
+
+                for (int covered = row; covered < lastRow; ++covered)
+                    remaining[covered] &= ~span;
+
+                quads.push_back({ static_cast<uint8_t>(row), static_cast<uint8_t>(firstCol),
+                    static_cast<uint8_t>(lastRow), static_cast<uint8_t>(lastCol), color });
+            }
+        }
+        quadsDirty = false;
+    }
+    return quads;
+}
+
+void TileChunk::rebuildOccupancy()
+{
+    occupiedCount = 0;
+    for (int row = 0; row < TILE_CHUNK_SIZE; ++row)
+    {
+        uint32_t bits = 0;
+        for (int col = 0; col < TILE_CHUNK_SIZE; ++col)
+        {
+            if (cells[row * TILE_CHUNK_SIZE + col] != IM_COL32_BLACK_TRANS)
+                bits |= 1u << col;
+        }
+        occupancy[row] = bits;
+        occupiedCount += bitCount(bits);
+    }
+}
+
+TileChunkGrid::~TileChunkGrid()
+{
+    clear();
+}
+
+TileChunkGrid& TileChunkGrid::operator=(TileChunkGrid&& other)
+{
+    if (this != &other)
+    {
+        clear();
+        m_chunkRows = std::exchange(other.m_chunkRows, 0);
+        m_chunkCols = std::exchange(other.m_chunkCols, 0);
+        m_chunks = std::move(other.m_chunks);
+        m_allocatedChunks = std::exchange(other.m_allocatedChunks, 0);
+        m_backing = std::move(other.m_backing);
+        m_pagedOutChunks = std::exchange(other.m_pagedOutChunks, 0);
+        m_mappedChunks = std::exchange(other.m_mappedChunks, 0);
+        m_file = std::move(other.m_file);
+        m_store = std::move(other.m_store);
+        m_useEpoch = other.m_useEpoch;
+        m_unsaved = std::move(other.m_unsaved);
+        other.m_chunks.clear();
+        other.m_backing.clear();
+        other.m_unsaved.clear();
+    }
+    return *this;
+}
+
+void TileChunkGrid::clear()
+{
+    if (m_store != nullptr)
+    {
+        for (const ChunkBacking& backing : m_backing)
+        {
+            if (backing.storeSlot >= 0)
+                m_store->release(backing.storeSlot);
+        }
+    }
+    m_chunks.clear();
+    m_backing.clear();
+    m_unsaved.clear();
+    m_chunkRows = 0;
+    m_chunkCols = 0;
+    m_allocatedChunks = 0;
+    m_pagedOutChunks = 0;
+    m_mappedChunks = 0;
+    m_file.reset();
+    m_store.reset();
+}
+
+void TileChunkGrid::grow(int chunkRows, int chunkCols)
+{
+    std::vector<std::unique_ptr<TileChunk>> chunks(static_cast<size_t>(chunkRows) * chunkCols);
+    for (int row = 0; row < m_chunkRows; ++row)
+    {
+        for (int col = 0; col < m_chunkCols; ++col)
+        {
+            chunks[static_cast<size_t>(row) * chunkCols + col] = std::move(m_chunks[static_cast<size_t>(row) * m_chunkCols + col]);
+        }
+    }
+    m_chunks = std::move(chunks);
+
+    if (!m_backing.empty())
+    {
+        std::vector<ChunkBacking> backing(static_cast<size_t>(chunkRows) * chunkCols);
+        for (int row = 0; row < m_chunkRows; ++row)
+        {
+            for (int col = 0; col < m_chunkCols; ++col)
+                backing[static_cast<size_t>(row) * chunkCols + col] = m_backing[static_cast<size_t>(row) * m_chunkCols + col];
+        }
+        m_backing = std::move(backing);
+    }
+    m_chunkRows = chunkRows;
+    m_chunkCols = chunkCols;
+}
+
+const ImU32* TileChunkGrid::readBacking(size_t index, ImU32* buffer) const
+{
+    const ChunkBacking& backing = m_backing[index];
+    if (backing.storeSlot < 0)
+        return backing.mapped;
+
+    //A store that cannot be read back leaves the chunk empty rather than showing stale cells
+    if (!m_store->read(backing.storeSlot, buffer))
+        std::fill(buffer, buffer + TILE_CHUNK_CELLS, IM_COL32_BLACK_TRANS);
+    return buffer;
+}
+
+TileChunk* TileChunkGrid::pageIn(size_t index) const
+{
+    auto chunk = std::make_unique<TileChunk>();
+    const ImU32* cells = readBacking(index, chunk->cells.data());
+    if (cells != chunk->cells.data())
+        std::memcpy(chunk->cells.data(), cells, sizeof(ImU32) * TILE_CHUNK_CELLS);
+    chunk->rebuildOccupancy();
+    chunk->quadsDirty = true;
+    chunk->compositeDirty = true;
+    chunk->dirty = false;
+    chunk->unsaved = m_backing[index].unsaved;
+    m_backing[index].unsaved = false;
+
+    ++m_allocatedChunks;
+    --m_pagedOutChunks;
+    m_chunks[index] = std::move(chunk);
+    return m_chunks[index].get();
+}
+
+void TileChunkGrid::releaseMapped(ChunkBacking& backing)
+{
+    if (backing.mapped == nullptr)
+        return;
+    backing.mapped = nullptr;
+    if (--m_mappedChunks == 0)
+        m_file.reset();
+}
+
+void TileChunkGrid::releaseBacking(ChunkBacking& backing)
+{
+    releaseMapped(backing);
+    if (backing.storeSlot >= 0)
+    {
+        m_store->release(backing.storeSlot);
+        backing.storeSlot = -1;
+    }
+}
+
+bool TileChunkGrid::evictChunk(int chunkRow, int chunkCol, const std::shared_ptr<ChunkStore>& store)
+{
+    if (chunkRow < 0 || chunkCol < 0 || chunkRow >= m_chunkRows || chunkCol >= m_chunkCols)
+        return false;
+    size_t index = static_cast<size_t>(chunkRow) * m_chunkCols + chunkCol;
+    TileChunk* chunk = m_chunks[index].get();
+    if (chunk == nullptr)
+        return false;
+
+    if (m_backing.empty())
+        m_backing.resize(m_chunks.size());
+    ChunkBacking& backing = m_backing[index];
+    if (chunk->occupiedCount == 0)
+    {
+        releaseBacking(backing);
+        backing.unsaved = false;
+    }
+    else
+    {
+        if (chunk->dirty || (backing.mapped == nullptr && backing.storeSlot < 0))
+        {
+            //Layers keep the store they first evicted into, their slots are only valid there
+            if (m_store == nullptr)
+                m_store = store;
+            int32_t slot = m_store->write(backing.storeSlot, chunk->cells.data());
+            if (slot < 0)
+                return false;
+            backing.storeSlot = slot;
+            releaseMapped(backing);
+        }
+        backing.unsaved = chunk->unsaved;
+        ++m_pagedOutChunks;
+    }
+
+    m_chunks[index].reset();
+    --m_allocatedChunks;
+    return true;
+}
+
+void TileChunkGrid::attachMapped(std::shared_ptr<const MappedFile> file, const std::vector<MappedChunk>& chunks)
+{
+    clear();
+
+    int chunkRows = 0;
+    int chunkCols = 0;
+    for (const MappedChunk& chunk : chunks)
+    {
+        chunkRows = std::max(chunkRows, chunk.chunkRow + 1);
+        chunkCols = std::max(chunkCols, chunk.chunkCol + 1);
+    }
+    if (chunks.empty())
+        return;
+
+    grow(chunkRows, chunkCols);
+    m_backing.resize(m_chunks.size());
+    for (const MappedChunk& chunk : chunks)
+    {
+        ChunkBacking& backing = m_backing[static_cast<size_t>(chunk.chunkRow) * m_chunkCols + chunk.chunkCol];
+        if (backing.mapped == nullptr)
+            ++m_mappedChunks;
+        backing.mapped = chunk.cells;
+    }
+    m_pagedOutChunks = m_mappedChunks;
+    m_file = std::move(file);
+}
+
+void TileChunkGrid::detachMapped(const std::shared_ptr<ChunkStore>& store)
+{
+    for (size_t index = 0; m_mappedChunks != 0 && index < m_backing.size(); ++index)
+    {
+        ChunkBacking& backing = m_backing[index];
+        if (backing.mapped == nullptr)
+            continue;
+
+        TileChunk* chunk = m_chunks[index].get();
+        if (chunk == nullptr)
+        {
+            if (m_store == nullptr)
+                m_store = store;
+            backing.storeSlot = m_store->write(-1, backing.mapped);
+            //Without room in the store the chunk has nowhere to go but memory
+            if (backing.storeSlot < 0)
+                chunk = pageIn(index);
+        }
+        if (chunk != nullptr)
+            chunk->dirty = true;
+        releaseMapped(backing);
+    }
+}
+
+void TileChunkGrid::markAllUnsaved()
+{
+    m_unsaved.clear();
+    for (int chunkRow = 0; chunkRow < m_chunkRows; ++chunkRow)
+    {
+        for (int chunkCol = 0; chunkCol < m_chunkCols; ++chunkCol)
+        {
+            size_t index = static_cast<size_t>(chunkRow) * m_chunkCols + chunkCol;
+            if (m_chunks[index] != nullptr)
+            {
+                m_chunks[index]->unsaved = true;
+                m_unsaved.push_back({ chunkRow, chunkCol });
+            }
+            else if (isPagedOut(index))
+            {
+                m_backing[index].unsaved = true;
+                m_unsaved.push_back({ chunkRow, chunkCol });
+            }
+        }
+    }
+}
+
+void TileChunkGrid::clearUnsaved()
+{
+    for (const ChunkCoord& coord : m_unsaved)
+    {
+        size_t index = static_cast<size_t>(coord.chunkRow) * m_chunkCols + coord.chunkCol;
+        if (m_chunks[index] != nullptr)
+            m_chunks[index]->unsaved = false;
+        else if (!m_backing.empty())
+            m_backing[index].unsaved = false;
+    }
+    m_unsaved.clear();
+}
+
+void TileLayer::writeChunk(int chunkRow, int chunkCol, const ImU32* cells)
+{
+    if (chunkRow < 0 || chunkCol < 0)
+        return;
+
+    TileChunk* chunk = m_chunks.findChunk(chunkRow, chunkCol);
+    if (chunk == nullptr)
+    {
+        if (cells == nullptr)
+            return;
+        chunk = &m_chunks.touchChunk(chunkRow, chunkCol);
+    }
+
+    if (cells != nullptr)
+        std::memcpy(chunk->cells.data(), cells, sizeof(ImU32) * TILE_CHUNK_CELLS);
+    else
+        chunk->cells.fill(IM_COL32_BLACK_TRANS);
+    chunk->rebuildOccupancy();
+    chunk->quadsDirty = true;
+    chunk->compositeDirty = true;
+    chunk->dirty = true;
+    m_chunks.markUnsaved(chunkRow, chunkCol, *chunk);
+}
+
+void TileLayer::readRect(int firstRow, int firstCol, TileBuffer& buffer) const
+{
+    buffer.cells.assign(static_cast<size_t>(buffer.rows) * buffer.cols, IM_COL32_BLACK_TRANS);
+    if (buffer.rows <= 0 || buffer.cols <= 0)
+        return;
+
+    const int lastRow = firstRow + buffer.rows;
+    const int lastCol = firstCol + buffer.cols;
+    //Cells at negative rows or columns are empty, a rectangle lying there entirely has nothing to copy
+    if (lastRow <= 0 || lastCol <= 0)
+        return;
+    for (int chunkRow = std::max(firstRow, 0) / TILE_CHUNK_SIZE; chunkRow <= (lastRow - 1) / TILE_CHUNK_SIZE; ++chunkRow)
+    {
+        for (int chunkCol = std::max(firstCol, 0) / TILE_CHUNK_SIZE; chunkCol <= (lastCol - 1) / TILE_CHUNK_SIZE; ++chunkCol)
+        {
+            const TileChunk* chunk = m_chunks.findChunk(chunkRow, chunkCol);
+            if (chunk == nullptr || chunk->occupiedCount == 0)
+                continue;
+
+            int baseRow = chunkRow * TILE_CHUNK_SIZE;
+            int baseCol = chunkCol * TILE_CHUNK_SIZE;
+            int spanFirst = std::max(firstCol - baseCol, 0);
+            int spanLast = std::min(lastCol - baseCol, TILE_CHUNK_SIZE);
+            for (int row = std::max(firstRow - baseRow, 0); row < std::min(lastRow - baseRow, TILE_CHUNK_SIZE); ++row)
+            {
+                std::memcpy(buffer.row(baseRow + row - firstRow) + baseCol + spanFirst - firstCol,
+                    &chunk->cells[row * TILE_CHUNK_SIZE + spanFirst], sizeof(ImU32) * (spanLast - spanFirst));
+            }
+        }
+    }
+}
+
+void TileLayer::writeRect(int firstRow, int firstCol, const TileBuffer& buffer)
+{
+    if (firstRow < 0 || firstCol < 0 || buffer.rows <= 0 || buffer.cols <= 0)
+        return;
+
+    const int lastRow = firstRow + buffer.rows;
+    const int lastCol = firstCol + buffer.cols;
+    for (int chunkRow = firstRow / TILE_CHUNK_SIZE; chunkRow <= (lastRow - 1) / TILE_CHUNK_SIZE; ++chunkRow)
+    {
+        for (int chunkCol = firstCol / TILE_CHUNK_SIZE; chunkCol <= (lastCol - 1) / TILE_CHUNK_SIZE; ++chunkCol)
+        {
+            int baseRow = chunkRow * TILE_CHUNK_SIZE;
+            int baseCol = chunkCol * TILE_CHUNK_SIZE;
+            int spanFirst = std::max(firstCol - baseCol, 0);
+            int spanLast = std::min(lastCol - baseCol, TILE_CHUNK_SIZE);
+            int rowFirst = std::max(firstRow - baseRow, 0);
+            int rowLast = std::min(lastRow - baseRow, TILE_CHUNK_SIZE);
+
+            TileChunk* chunk = m_chunks.findChunk(chunkRow, chunkCol);
+            if (chunk == nullptr)
+            {
+                bool empty = true;
+                for (int row = rowFirst; row < rowLast && empty; ++row)
+                {
+                    const ImU32* cells = buffer.row(baseRow + row - firstRow) + baseCol + spanFirst - firstCol;
+                    empty = std::all_of(cells, cells + spanLast - spanFirst, [](ImU32 cell) { return cell == IM_COL32_BLACK_TRANS; });
+                }
+                if (empty)
+                    continue;
+                chunk = &m_chunks.touchChunk(chunkRow, chunkCol);
+            }
+
+            bool changed = false;
+            for (int row = rowFirst; row < rowLast; ++row)
+                changed |= chunk->writeSpan(row, spanFirst, spanLast, buffer.row(baseRow + row - firstRow) + baseCol + spanFirst - firstCol);
+            if (changed)
+                m_chunks.markUnsaved(chunkRow, chunkCol, *chunk);
+        }
+    }
+}
+
+void TileLayer::fillSpans(const std::vector<TileSpan>& spans, ImU32 color)
+{
+    color = normalize(color);
+    for (const TileSpan& span : spans)
+    {
+        int firstCol = std::max(span.firstCol, 0);
+        if (span.row < 0 || firstCol >= span.lastCol)
+            continue;
+
+        const int chunkRow = span.row / TILE_CHUNK_SIZE;
+        const int row = span.row % TILE_CHUNK_SIZE;
+        for (int chunkCol = firstCol / TILE_CHUNK_SIZE; chunkCol <= (span.lastCol - 1) / TILE_CHUNK_SIZE; ++chunkCol)
+        {
+            int baseCol = chunkCol * TILE_CHUNK_SIZE;
+            fillChunkSpan(chunkRow, chunkCol, row, std::max(firstCol - baseCol, 0), std::min(span.lastCol - baseCol, TILE_CHUNK_SIZE), color);
+        }
+    }
+}
+
+void TileLayer::fillChunkSpan(int chunkRow, int chunkCol, int row, int firstCol, int lastCol, ImU32 color)
+{
+    if (chunkRow < 0 || chunkCol < 0)
+        return;
+
+    TileChunk* chunk = m_chunks.findChunk(chunkRow, chunkCol);
+    if (chunk == nullptr)
+    {
+        if (color == IM_COL32_BLACK_TRANS)
+            return;
+        chunk = &m_chunks.touchChunk(chunkRow, chunkCol);
+    }
+    if (chunk->fillSpan(row, firstCol, lastCol, color))
+        m_chunks.markUnsaved(chunkRow, chunkCol, *chunk);
+}
+
+void TileLayer::fillChunkMasked(int chunkRow, int chunkCol, const uint32_t* rowMasks, ImU32 color)
+{
+    if (chunkRow < 0 || chunkCol < 0)
+        return;
+
+    TileChunk* chunk = m_chunks.findChunk(chunkRow, chunkCol);
+    if (chunk == nullptr)
+    {
+        if (color == IM_COL32_BLACK_TRANS)
+            return;
+        chunk = &m_chunks.touchChunk(chunkRow, chunkCol);
+    }
+    bool changed = false;
+    for (int row = 0; row < TILE_CHUNK_SIZE; ++row)
+        changed |= chunk->fillMasked(row, rowMasks[row], color);
+    if (changed)
+        m_chunks.markUnsaved(chunkRow, chunkCol, *chunk);
+}
+
+void TileLayer::writeChunkMasked(int chunkRow, int chunkCol, const uint32_t* rowMasks, const ImU32* cells)
+{
+    if (chunkRow < 0 || chunkCol < 0)
+        return;
+
+    TileChunk& chunk = m_chunks.touchChunk(chunkRow, chunkCol);
+    bool changed = false;
+    for (int row = 0; row < TILE_CHUNK_SIZE; ++row)
+        changed |= chunk.writeMasked(row, rowMasks[row], cells + row * TILE_CHUNK_SIZE);
+    if (changed)
+        m_chunks.markUnsaved(chunkRow, chunkCol, chunk);
+}
+
+void TileLayer::writeChunkSpan(int chunkRow, int chunkCol, int row, int firstCol, int lastCol, const ImU32* colors)
+{
+    if (chunkRow < 0 || chunkCol < 0)
+        return;
+
+    TileChunk& chunk = m_chunks.touchChunk(chunkRow, chunkCol);
+    if (chunk.writeSpan(row, firstCol, lastCol, colors))
+        m_chunks.markUnsaved(chunkRow, chunkCol, chunk);
+}
+
+void TileLayer::fillRect(int firstRow, int firstCol, int lastRow, int lastCol, ImU32 color)
+{
+    firstRow = std::max(firstRow, 0);
+    firstCol = std::max(firstCol, 0);
+    if (firstRow >= lastRow || firstCol >= lastCol)
+        return;
+
+    color = normalize(color);
+    for (int chunkRow = firstRow / TILE_CHUNK_SIZE; chunkRow <= (lastRow - 1) / TILE_CHUNK_SIZE; ++chunkRow)
+    {
+        for (int chunkCol = firstCol / TILE_CHUNK_SIZE; chunkCol <= (lastCol - 1) / TILE_CHUNK_SIZE; ++chunkCol)
+        {
+            TileChunk* chunk = m_chunks.findChunk(chunkRow, chunkCol);
+            if (chunk == nullptr)
+            {
+                if (color == IM_COL32_BLACK_TRANS)
+                    continue;
+                chunk = &m_chunks.touchChunk(chunkRow, chunkCol);
+            }
+
+            int baseRow = chunkRow * TILE_CHUNK_SIZE;
+            int baseCol = chunkCol * TILE_CHUNK_SIZE;
+            int spanFirst = std::max(firstCol - baseCol, 0);
+            int spanLast = std::min(lastCol - baseCol, TILE_CHUNK_SIZE);
+            bool changed = false;
+            for (int row = std::max(firstRow - baseRow, 0); row < std::min(lastRow - baseRow, TILE_CHUNK_SIZE); ++row)
+                changed |= chunk->fillSpan(row, spanFirst, spanLast, color);
+            if (changed)
+                m_chunks.markUnsaved(chunkRow, chunkCol, *chunk);
+        }
+    }
+}
@@ -0,0 +1,668 @@
+#pragma once
+#include <imgui.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define TILE_SSE2 1
+#endif
+
+//Tiles are kept in square chunks of TILE_CHUNK_SIZE x TILE_CHUNK_SIZE cells.
+//A chunk is only allocated the first time one of its cells is written, so memory
+//grows with the painted area, and a lookup is two array indexings.
+//Cells are packed RGBA8 colours (IM_COL32 layout), IM_COL32_BLACK_TRANS is an empty cell.
+constexpr int TILE_CHUNK_SIZE = 32;
+constexpr int TILE_CHUNK_CELLS = TILE_CHUNK_SIZE * TILE_CHUNK_SIZE;
+
+//Index of the lowest set bit of a non-zero occupancy word
+inline int lowestSetBit(uint32_t bits)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+//Index of the highest set bit of a non-zero word
+inline int highestSetBit(uint32_t bits)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, bits);
+    return static_cast<int>(index);
+#else
+    return 31 - __builtin_clz(bits);
+#endif
+}
+
+inline int bitCount(uint32_t bits)
+{
+#if defined(_MSC_VER)
+    return static_cast<int>(__popcnt(bits));
+#else
+    return __builtin_popcount(bits);
+#endif
+}
+
+//Occupancy mask of the columns [firstCol, lastCol) of a chunk row
+inline uint32_t tileSpanMask(int firstCol, int lastCol)
+{
+    return (lastCol == TILE_CHUNK_SIZE ? ~0u : (1u << lastCol) - 1) & ~((1u << firstCol) - 1);
+}
+
+//Bit col is set when cells[col] equals color, over the TILE_CHUNK_SIZE cells of a chunk row
+inline uint32_t tileRowMatch(const ImU32* cells, ImU32 color)
+{
+    uint32_t mask = 0;
+#if defined(TILE_SSE2)
+    const __m128i target = _mm_set1_epi32(static_cast<int>(color));
+    for (int col = 0; col < TILE_CHUNK_SIZE; col += 4)
+    {
+        __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cells + col)), target);
+        mask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(equal))) << col;
+    }
+#else
+    for (int col = 0; col < TILE_CHUNK_SIZE; ++col)
+        mask |= static_cast<uint32_t>(cells[col] == color) << col;
+#endif
+    return mask;
+}
+
+//Run of cells [firstCol, lastCol) of one row in layer cell coordinates
+struct TileSpan
+{
+    int row;
+    int firstCol, lastCol;
+};
+
+//Rectangle of cells copied out of a layer, row-major and contiguous, e.g. the clipboard
+struct TileBuffer
+{
+    int rows = 0;
+    int cols = 0;
+    std::vector<ImU32> cells;
+
+    const ImU32* row(int index) const
+    {
+        return cells.data() + static_cast<size_t>(index) * cols;
+    }
+
+    ImU32* row(int index)
+    {
+        return cells.data() + static_cast<size_t>(index) * cols;
+    }
+};
+
+//Filled rectangle of one colour in chunk-local cell coordinates, last row and column exclusive.
+struct TileQuad
+{
+    uint8_t firstRow, firstCol;
+    uint8_t lastRow, lastCol;
+    ImU32 color;
+};
+
+struct TileChunk
+{
+    std::array<ImU32, TILE_CHUNK_CELLS> cells{};
+    //One bit per painted cell, one word per chunk row. Lets renderers walk painted cells only.
+    std::array<uint32_t, TILE_CHUNK_SIZE> occupancy{};
+    int occupiedCount = 0;
+
+    //Render cache: quads covering the painted cells, rebuilt on the first getQuads after a change.
+    //A chunk is the unit of invalidation, so painting only rebuilds the chunks it touched.
+    mutable std::vector<TileQuad> quads;
+    mutable bool quadsDirty = false;
+    //Set on every change, cleared by the LayerCompositor once it has blended the chunk (see Compositor.h)
+    mutable bool compositeDirty = true;
+
+    //Cells changed since the chunk was last written to or read from its backing (see TileChunkGrid)
+    bool dirty = true;
+    //Cells changed since the chunk was last handed to the autosave journal (see Autosave.h)
+    bool unsaved = false;
+    //Use epoch of the last access, eviction drops the least recently used chunks first
+    uint32_t lastUse = 0;
+
+    //Returns whether the cell changed
+    bool set(int row, int col, ImU32 color)
+    {
+        ImU32& cell = cells[row * TILE_CHUNK_SIZE + col];
+        if (cell == color)
+            return false;
+
+        uint32_t bit = 1u << col;
+        bool wasOccupied = (occupancy[row] & bit) != 0;
+        bool isOccupied = color != IM_COL32_BLACK_TRANS;
+        cell = color;
+        quadsDirty = true;
+        compositeDirty = true;
+        dirty = true;
+        if (isOccupied != wasOccupied)
+        {
+            occupancy[row] ^= bit;
+            occupiedCount += isOccupied ? 1 : -1;
+        }
+        return true;
+    }
+
+    //Sets the cells [firstCol, lastCol) of a chunk row to one colour, returns whether any changed
+    bool fillSpan(int row, int firstCol, int lastCol, ImU32 color)
+    {
+        ImU32* cell = &cells[row * TILE_CHUNK_SIZE];
+        bool changed = false;
+        for (int col = firstCol; col < lastCol; ++col)
+        {
+            changed |= cell[col] != color;
+            cell[col] = color;
+        }
+        if (!changed)
+            return false;
+
+        uint32_t before = occupancy[row];
+        uint32_t span = tileSpanMask(firstCol, lastCol);
+        occupancy[row] = color != IM_COL32_BLACK_TRANS ? before | span : before & ~span;
+        occupiedCount += bitCount(occupancy[row]) - bitCount(before);
+        quadsDirty = true;
+        compositeDirty = true;
+        dirty = true;
+        return true;
+    }
+
+    //Copies colours into the cells [firstCol, lastCol) of a chunk row, returns whether any changed
+    bool writeSpan(int row, int firstCol, int lastCol, const ImU32* colors)
+    {
+        ImU32* cell = &cells[row * TILE_CHUNK_SIZE];
+        const size_t bytes = sizeof(ImU32) * (lastCol - firstCol);
+        if (std::memcmp(cell + firstCol, colors, bytes) == 0)
+            return false;
+
+        std::memcpy(cell + firstCol, colors, bytes);
+        uint32_t before = occupancy[row];
+        occupancy[row] = ~tileRowMatch(cell, IM_COL32_BLACK_TRANS);
+        occupiedCount += bitCount(occupancy[row]) - bitCount(before);
+        quadsDirty = true;
+        compositeDirty = true;
+        dirty = true;
+        return true;
+    }
+
+    //Sets the cells of row whose bit is set in mask to one colour, returns whether any changed
+    bool fillMasked(int row, uint32_t mask, ImU32 color)
+    {
+        bool changed = false;
+        while (mask != 0)
+        {
+            int firstCol = lowestSetBit(mask);
+            uint32_t rest = ~mask & ~((1u << firstCol) - 1);
+            int lastCol = rest != 0 ? lowestSetBit(rest) : TILE_CHUNK_SIZE;
+            changed |= fillSpan(row, firstCol, lastCol, color);
+            mask &= ~tileSpanMask(firstCol, lastCol);
+        }
+        return changed;
+    }
+
+    //Copies the cells of row whose bit is set in mask from rowCells, indexed by column
+    bool writeMasked(int row, uint32_t mask, const ImU32* rowCells)
+    {
+        bool changed = false;
+        while (mask != 0)
+        {
+            int firstCol = lowestSetBit(mask);
+            uint32_t rest = ~mask & ~((1u << firstCol) - 1);
+            int lastCol = rest != 0 ? lowestSetBit(rest) : TILE_CHUNK_SIZE;
+            changed |= writeSpan(row, firstCol, lastCol, rowCells + firstCol);
+            mask &= ~tileSpanMask(firstCol, lastCol);
+        }
+        return changed;
+    }
+
+    //Recomputes occupancy from cells that were copied in as a whole
+    void rebuildOccupancy();
+
+    //Greedy meshing: each quad is grown right over equally coloured cells, then down while
+    //the whole span below matches, so solid areas collapse into a handful of quads.
+    const std::vector<TileQuad>& getQuads() const;
+
+    bool spanHasColor(int row, int firstCol, int lastCol, ImU32 color) const
+    {
+        const ImU32* cell = &cells[row * TILE_CHUNK_SIZE];
+        for (int col = firstCol; col < lastCol; ++col)
+        {
+            if (cell[col] != color)
+                return false;
+        }
+        return true;
+    }
+};
+static_assert(TILE_CHUNK_SIZE == 32, "TileChunk::occupancy holds one 32-bit word per chunk row");
+
+class ChunkStore;
+class MappedFile;
+
+//Cells of a chunk stored in a memory mapped project file (see ProjectFile.h)
+struct MappedChunk
+{
+    int chunkRow, chunkCol;
+    const ImU32* cells;
+};
+
+
+//Chunk directory of a layer. The directory is a dense row-major array of
+//chunk pointers which grows when a cell outside of it is written.
+//Chunks are resident (in memory) or paged out. A paged out chunk is backed either by the mapped
+//project file it was loaded from or by a slot of the grid's ChunkStore, and is paged in, copied
+//into a TileChunk, on first access. A layer loaded from a project therefore starts paged out, and
+//evictChunk pages a resident chunk back out, writing it to the store only if it is dirty.
+//Paging in is invisible to callers, which is why const lookups may fill the directory.
+class TileChunkGrid
+{
+private:
+    struct ChunkBacking
+    {
+        const ImU32* mapped = nullptr;
+        int32_t storeSlot = -1;
+        //TileChunk::unsaved of the chunk while it is paged out
+        bool unsaved = false;
+    };
+
+    struct ChunkCoord
+    {
+        int chunkRow, chunkCol;
+    };
+
+    int m_chunkRows = 0;
+    int m_chunkCols = 0;
+    mutable std::vector<std::unique_ptr<TileChunk>> m_chunks;
+    mutable size_t m_allocatedChunks = 0;
+
+    //Per directory slot, where the chunk is kept when it is not resident.
+    //Empty until a project is attached or a chunk is evicted.
+    mutable std::vector<ChunkBacking> m_backing;
+    mutable size_t m_pagedOutChunks = 0;
+    size_t m_mappedChunks = 0;
+    std::shared_ptr<const MappedFile> m_file;
+    std::shared_ptr<ChunkStore> m_store;
+    uint32_t m_useEpoch = 0;
+
+    //Chunks marked unsaved since the last takeUnsaved, possibly listed twice
+    std::vector<ChunkCoord> m_unsaved;
+
+    void grow(int chunkRows, int chunkCols);
+    TileChunk* pageIn(size_t index) const;
+    void releaseBacking(ChunkBacking& backing);
+    void releaseMapped(ChunkBacking& backing);
+    void clear();
+
+    bool isPagedOut(size_t index) const
+    {
+        return m_pagedOutChunks != 0 && m_chunks[index] == nullptr &&
+            (m_backing[index].mapped != nullptr || m_backing[index].storeSlot >= 0);
+    }
+
+public:
+    TileChunkGrid() = default;
+    ~TileChunkGrid();
+    TileChunkGrid(TileChunkGrid&&) = default;
+    TileChunkGrid& operator=(TileChunkGrid&& other);
+
+    //Resident chunks
+    size_t getAllocatedChunkCount() const
+    {
+        return m_allocatedChunks;
+    }
+
+    size_t getPagedOutChunkCount() const
+    {
+        return m_pagedOutChunks;
+    }
+
+    const TileChunk* findChunk(int chunkRow, int chunkCol) const
+    {
+        if (chunkRow < 0 || chunkCol < 0 || chunkRow >= m_chunkRows || chunkCol >= m_chunkCols)
+            return nullptr;
+        size_t index = static_cast<size_t>(chunkRow) * m_chunkCols + chunkCol;
+        TileChunk* chunk = m_chunks[index].get();
+        if (chunk == nullptr)
+        {
+            if (!isPagedOut(index))
+                return nullptr;
+            chunk = pageIn(index);
+        }
+        chunk->lastUse = m_useEpoch;
+        return chunk;
+    }
+
+    TileChunk* findChunk(int chunkRow, int chunkCol)
+    {
+        return const_cast<TileChunk*>(static_cast<const TileChunkGrid*>(this)->findChunk(chunkRow, chunkCol));
+    }
+
+    TileChunk& touchChunk(int chunkRow, int chunkCol)
+    {
+        if (chunkRow >= m_chunkRows || chunkCol >= m_chunkCols)
+        {
+            //Grow geometrically so painting outwards does not reallocate the directory every chunk
+            int chunkRows = m_chunkRows;
+            int chunkCols = m_chunkCols;
+            while (chunkRows <= chunkRow)
+                chunkRows = chunkRows == 0 ? chunkRow + 1 : chunkRows * 2;
+            while (chunkCols <= chunkCol)
+                chunkCols = chunkCols == 0 ? chunkCol + 1 : chunkCols * 2;
+            grow(chunkRows, chunkCols);
+        }
+
+        size_t index = static_cast<size_t>(chunkRow) * m_chunkCols + chunkCol;
+        TileChunk* chunk = m_chunks[index].get();
+        if (chunk == nullptr)
+        {
+            if (isPagedOut(index))
+            {
+                chunk = pageIn(index);
+            }
+            else
+            {
+                m_chunks[index] = std::make_unique<TileChunk>();
+                chunk = m_chunks[index].get();
+                ++m_allocatedChunks;
+            }
+        }
+        chunk->lastUse = m_useEpoch;
+        return *chunk;
+    }
+
+    //Replaces the contents with chunks of a mapped file, kept alive while any chunk is backed by it
+    void attachMapped(std::shared_ptr<const MappedFile> file, const std::vector<MappedChunk>& chunks);
+
+    //Moves every chunk backed by the mapped file into store and releases the file
+    void detachMapped(const std::shared_ptr<ChunkStore>& store);
+
+    const MappedFile* getMappedFile() const
+    {
+        return m_file.get();
+    }
+
+    //Epoch stamped on chunks as they are accessed
+    void setUseEpoch(uint32_t epoch)
+    {
+        m_useEpoch = epoch;
+    }
+
+    //Pages a resident chunk out. Empty chunks are dropped, dirty ones written to store first.
+    //Returns false if the chunk is not resident or could not be written, it then stays resident.
+    bool evictChunk(int chunkRow, int chunkCol, const std::shared_ptr<ChunkStore>& store);
+
+    //Lists a chunk that was just changed for the next takeUnsaved
+    void markUnsaved(int chunkRow, int chunkCol, TileChunk& chunk)
+    {
+        if (!chunk.unsaved)
+        {
+            chunk.unsaved = true;
+            m_unsaved.push_back({ chunkRow, chunkCol });
+        }
+    }
+
+    //Marks every stored chunk unsaved, so the next takeUnsaved calls hand out the whole layer
+    void markAllUnsaved();
+
+    void clearUnsaved();
+
+    bool hasUnsaved() const
+    {
+        return !m_unsaved.empty();
+    }
+
+    //Hands up to maxChunks unsaved chunks to visit(chunkRow, chunkCol, cells) and clears their
+    //flag. cells is nullptr for a chunk that no longer exists and is only valid during the call.
+    template<typename Visit>
+    void takeUnsaved(size_t maxChunks, Visit visit)
+    {
+        std::array<ImU32, TILE_CHUNK_CELLS> buffer;
+        for (; maxChunks != 0 && !m_unsaved.empty(); --maxChunks)
+        {
+            ChunkCoord coord = m_unsaved.back();
+            m_unsaved.pop_back();
+
+            size_t index = static_cast<size_t>(coord.chunkRow) * m_chunkCols + coord.chunkCol;
+            if (m_chunks[index] != nullptr)
+            {
+                if (m_chunks[index]->unsaved)
+                {
+                    m_chunks[index]->unsaved = false;
+                    visit(coord.chunkRow, coord.chunkCol, m_chunks[index]->cells.data());
+                }
+            }
+            else if (isPagedOut(index))
+            {
+                if (m_backing[index].unsaved)
+                {
+                    m_backing[index].unsaved = false;
+                    visit(coord.chunkRow, coord.chunkCol, readBacking(index, buffer.data()));
+                }
+            }
+            else
+            {
+                //Erased and dropped by eviction since it was listed
+                visit(coord.chunkRow, coord.chunkCol, static_cast<const ImU32*>(nullptr));
+            }
+        }
+    }
+
+    //Calls visit(chunkRow, chunkCol, chunk) for every resident chunk
+    template<typename Visit>
+    void forEachResidentChunk(Visit visit) const
+    {
+        for (int chunkRow = 0; chunkRow < m_chunkRows; ++chunkRow)
+        {
+            for (int chunkCol = 0; chunkCol < m_chunkCols; ++chunkCol)
+            {
+                const TileChunk* chunk = m_chunks[static_cast<size_t>(chunkRow) * m_chunkCols + chunkCol].get();
+                if (chunk != nullptr)
+                    visit(chunkRow, chunkCol, *chunk);
+            }
+        }
+    }
+
+    //Calls visit(chunkRow, chunkCol, cells) for every chunk holding painted cells, in directory order.
+    //Paged out chunks are visited from their backing without paging them in; cells of a chunk
+    //read from the store are only valid during the call.
+    template<typename Visit>
+    void forEachStoredChunk(Visit visit) const
+    {
+        std::array<ImU32, TILE_CHUNK_CELLS> buffer;
+        for (int chunkRow = 0; chunkRow < m_chunkRows; ++chunkRow)
+        {
+            for (int chunkCol = 0; chunkCol < m_chunkCols; ++chunkCol)
+            {
+                size_t index = static_cast<size_t>(chunkRow) * m_chunkCols + chunkCol;
+                if (m_chunks[index] != nullptr)
+                {
+                    if (m_chunks[index]->occupiedCount != 0)
+                        visit(chunkRow, chunkCol, m_chunks[index]->cells.data());
+                }
+                else if (isPagedOut(index))
+                {
+                    visit(chunkRow, chunkCol, readBacking(index, buffer.data()));
+                }
+            }
+        }
+    }
+
+private:
+    //Cells of a paged out chunk, from the mapping or read from the store into buffer
+    const ImU32* readBacking(size_t index, ImU32* buffer) const;
+};
+
+
+//A layer holds tiles at a single canonical resolution. Painting with a larger pen is a
+//block fill of canonical tiles (see Grid::setCellColor), so there is one grid to look up.
+class TileLayer
+{
+private:
+    TileChunkGrid m_chunks;
+    bool m_isVisible;
+
+public:
+    //Fully transparent colours are invisible, they are stored as empty cells
+    static ImU32 normalize(ImU32 color)
+    {
+        return ((color >> IM_COL32_A_SHIFT) & 0xFF) == 0 ? IM_COL32_BLACK_TRANS : color;
+    }
+
+    TileLayer(bool isVisible = true) : m_isVisible(isVisible)
+    {
+    }
+
+    //Negative cell coordinates are outside of the canvas and are ignored.
+    void setTile(int row, int col, ImU32 color) {
+        if (row < 0 || col < 0)
+            return;
+
+        color = normalize(color);
+        const int chunkRow = row / TILE_CHUNK_SIZE;
+        const int chunkCol = col / TILE_CHUNK_SIZE;
+        if (color == IM_COL32_BLACK_TRANS && m_chunks.findChunk(chunkRow, chunkCol) == nullptr)
+            return;
+
+        TileChunk& chunk = m_chunks.touchChunk(chunkRow, chunkCol);
+        if (chunk.set(row % TILE_CHUNK_SIZE, col % TILE_CHUNK_SIZE, color))
+            m_chunks.markUnsaved(chunkRow, chunkCol, chunk);
+    }
+
+    ImU32 getTile(int row, int col) const
+    {
+        if (row < 0 || col < 0)
+            return IM_COL32_BLACK_TRANS;
+
+        const TileChunk* chunk = m_chunks.findChunk(row / TILE_CHUNK_SIZE, col / TILE_CHUNK_SIZE);
+        if (chunk == nullptr)
+            return IM_COL32_BLACK_TRANS;
+
+        return chunk->cells[(row % TILE_CHUNK_SIZE) * TILE_CHUNK_SIZE + col % TILE_CHUNK_SIZE];
+    }
+
+    //Sets every cell of [firstRow, lastRow) x [firstCol, lastCol) to one colour, one chunk row span at a time.
+    void fillRect(int firstRow, int firstCol, int lastRow, int lastCol, ImU32 color);
+
+    //Copies the cells of [firstRow, firstRow + buffer.rows) x [firstCol, firstCol + buffer.cols) into
+    //buffer, and back: one memcpy per chunk row segment. Unpainted chunks are not allocated by writes
+    //of empty cells.
+    void readRect(int firstRow, int firstCol, TileBuffer& buffer) const;
+    void writeRect(int firstRow, int firstCol, const TileBuffer& buffer);
+
+    //Sets every cell of the spans to one colour, a chunk row segment at a time
+    void fillSpans(const std::vector<TileSpan>& spans, ImU32 color);
+
+    //Sets the cells [firstCol, lastCol) of row of a chunk to one normalized colour, or to
+    //colors[0, lastCol - firstCol). Used to replay history spans without going cell by cell.
+    void fillChunkSpan(int chunkRow, int chunkCol, int row, int firstCol, int lastCol, ImU32 color);
+    void writeChunkSpan(int chunkRow, int chunkCol, int row, int firstCol, int lastCol, const ImU32* colors);
+
+    //Sets the cells of a chunk whose bit is set in rowMasks[row] to one normalized colour,
+    //or copies them from the TILE_CHUNK_CELLS cells
+    void fillChunkMasked(int chunkRow, int chunkCol, const uint32_t* rowMasks, ImU32 color);
+    void writeChunkMasked(int chunkRow, int chunkCol, const uint32_t* rowMasks, const ImU32* cells);
+
+    //Replaces every cell of a chunk, nullptr empties it
+    void writeChunk(int chunkRow, int chunkCol, const ImU32* cells);
+
+    //Chunk holding the cells [chunkRow * TILE_CHUNK_SIZE, +TILE_CHUNK_SIZE) x [chunkCol * TILE_CHUNK_SIZE, +TILE_CHUNK_SIZE),
+    //or nullptr if none of them was ever painted.
+    const TileChunk* findChunk(int chunkRow, int chunkCol) const
+    {
+        return m_chunks.findChunk(chunkRow, chunkCol);
+    }
+
+    size_t getAllocatedChunkCount() const
+    {
+        return m_chunks.getAllocatedChunkCount();
+    }
+
+    void attachMapped(std::shared_ptr<const MappedFile> file, const std::vector<MappedChunk>& chunks)
+    {
+        m_chunks.attachMapped(std::move(file), chunks);
+    }
+
+    size_t getPagedOutChunkCount() const
+    {
+        return m_chunks.getPagedOutChunkCount();
+    }
+
+    void detachMapped(const std::shared_ptr<ChunkStore>& store)
+    {
+        m_chunks.detachMapped(store);
+    }
+
+    //Project file the layer still pages chunks in from, or nullptr
+    const MappedFile* getMappedFile() const
+    {
+        return m_chunks.getMappedFile();
+    }
+
+    void setUseEpoch(uint32_t epoch)
+    {
+        m_chunks.setUseEpoch(epoch);
+    }
+
+    bool evictChunk(int chunkRow, int chunkCol, const std::shared_ptr<ChunkStore>& store)
+    {
+        return m_chunks.evictChunk(chunkRow, chunkCol, store);
+    }
+
+    template<typename Visit>
+    void forEachResidentChunk(Visit visit) const
+    {
+        m_chunks.forEachResidentChunk(visit);
+    }
+
+    void markAllUnsaved()
+    {
+        m_chunks.markAllUnsaved();
+    }
+
+    void clearUnsaved()
+    {
+        m_chunks.clearUnsaved();
+    }
+
+    bool hasUnsaved() const
+    {
+        return m_chunks.hasUnsaved();
+    }
+
+    template<typename Visit>
+    void takeUnsaved(size_t maxChunks, Visit visit)
+    {
+        m_chunks.takeUnsaved(maxChunks, visit);
+    }
+
+    template<typename Visit>
+    void forEachStoredChunk(Visit visit) const
+    {
+        m_chunks.forEachStoredChunk(visit);
+    }
+
+    void setVisibility(bool visible)
+    {
+        m_isVisible = visible;
+    }
+
+    bool getVisibility() const
+    {
+        return m_isVisible;
+    }
+
+    bool& isVisible()
+    {
+        return m_isVisible;
+    }
+};
@@ -0,0 +1,33 @@
+#include "Trace.h"
+#include <cstdio>
+
+uint32_t TraceRecorder::currentThreadId()
+{
+    //Small stable ids read better in trace viewers than hashed native ids
+    static std::atomic<uint32_t> nextId{ 1 };
+    thread_local uint32_t id = nextId.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+bool TraceRecorder::writeChromeTrace(const char* path) const
+{
+    FILE* file = std::fopen(path, "w");
+    if (file == nullptr)
+        return false;
+
+    uint64_t recorded = m_recorded.load(std::memory_order_acquire);
+    uint64_t first = recorded > CAPACITY ? recorded - CAPACITY : 0;
+
+    std::fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (uint64_t i = first; i < recorded; ++i)
+    {
+        const TraceEvent& event = m_events[i % CAPACITY];
+        std::fprintf(file, "%s\n{\"name\": \"%s\", \"cat\": \"tile\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f",
+            i == first ? "" : ",", event.name, event.threadId, event.startNs / 1000.0, event.durationNs / 1000.0);
+        if (event.argName != nullptr)
+            std::fprintf(file, ", \"args\": {\"%s\": %lld}", event.argName, event.argValue);
+        std::fprintf(file, "}");
+    }
+    std::fprintf(file, "\n]}\n");
+    return std::fclose(file) == 0;
+}
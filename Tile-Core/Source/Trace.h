@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+//Scoped instrumentation of the editor hot paths, written out as Chrome trace_event JSON
+//(chrome://tracing, ui.perfetto.dev). Scopes are only compiled in when TILE_TRACE is defined;
+//otherwise the TILE_TRACE_* macros expand to nothing.
+//Recording is off until setEnabled(true), e.g. from the editor's trace window; until then a scope
+//costs one flag load. Events go into a ring buffer allocated when recording is first enabled, so
+//recording never allocates and a long session keeps its most recent TraceRecorder::CAPACITY scopes.
+
+struct TraceEvent
+{
+    //Names must be string literals, only the pointer is stored
+    const char* name;
+    const char* argName;
+    long long argValue;
+    int64_t startNs;
+    int64_t durationNs;
+    uint32_t threadId;
+};
+
+class TraceRecorder
+{
+public:
+    static constexpr size_t CAPACITY = 1 << 16;
+
+private:
+    std::vector<TraceEvent> m_events;
+    std::atomic<uint64_t> m_recorded{ 0 };
+    std::atomic<bool> m_enabled{ false };
+    std::chrono::steady_clock::time_point m_origin = std::chrono::steady_clock::now();
+
+    TraceRecorder() = default;
+
+public:
+    static TraceRecorder& instance()
+    {
+        static TraceRecorder recorder;
+        return recorder;
+    }
+
+    int64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_origin).count();
+    }
+
+    bool isEnabled() const
+    {
+        return m_enabled.load(std::memory_order_acquire);
+    }
+
+    //Call it from the thread that owns the UI
+    void setEnabled(bool enabled)
+    {
+        //The ring is in place before any scope sees recording on
+        if (enabled && m_events.empty())
+            m_events.resize(CAPACITY);
+        m_enabled.store(enabled, std::memory_order_release);
+    }
+
+    void record(const char* name, const char* argName, long long argValue, int64_t startNs, int64_t durationNs)
+    {
+        uint64_t slot = m_recorded.fetch_add(1, std::memory_order_relaxed);
+        m_events[slot % CAPACITY] = { name, argName, argValue, startNs, durationNs, currentThreadId() };
+    }
+
+    //Number of events currently held, at most CAPACITY
+    size_t getEventCount() const
+    {
+        uint64_t recorded = m_recorded.load(std::memory_order_relaxed);
+        return recorded < CAPACITY ? static_cast<size_t>(recorded) : CAPACITY;
+    }
+
+    void clear()
+    {
+        m_recorded.store(0, std::memory_order_relaxed);
+    }
+
+    //Writes the held events oldest first as a Chrome trace. Call it from the thread that owns
+    //the UI; events recorded by other threads during the write may be torn.
+    bool writeChromeTrace(const char* path) const;
+
+private:
+    static uint32_t currentThreadId();
+};
+
+//Records the time between construction and destruction as one complete ("X") event
+class TraceScope
+{
+private:
+    const char* m_name;
+    const char* m_argName;
+    long long m_argValue;
+    int64_t m_start;
+
+public:
+    explicit TraceScope(const char* name, const char* argName = nullptr, long long argValue = 0) :
+        m_name(name),
+        m_argName(argName),
+        m_argValue(argValue),
+        m_start(TraceRecorder::instance().isEnabled() ? TraceRecorder::instance().now() : -1)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (m_start < 0)
+            return;
+        TraceRecorder& recorder = TraceRecorder::instance();
+        recorder.record(m_name, m_argName, m_argValue, m_start, recorder.now() - m_start);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#define TILE_TRACE_CONCAT_INNER(a, b) a##b
+#define TILE_TRACE_CONCAT(a, b) TILE_TRACE_CONCAT_INNER(a, b)
+
+#if defined(TILE_TRACE)
+#define TILE_TRACE_SCOPE(name) TraceScope TILE_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TILE_TRACE_SCOPE_ARG(name, argName, argValue) TraceScope TILE_TRACE_CONCAT(traceScope, __LINE__)(name, argName, argValue)
+#else
+#define TILE_TRACE_SCOPE(name)
+#define TILE_TRACE_SCOPE_ARG(name, argName, argValue)
+#endif
@@ -15,6 +15,8 @@
 #include <SFML/Window/Touch.hpp>
 #include <SFML/Window/Window.hpp>
 
+#include "Trace.h"
+
 #include <cassert>
 #include <cmath> // abs
 #include <cstddef> // offsetof, nullptr, size_t
@@ -126,6 +128,7 @@ ImTextureID convertGLTextureHandleToImTextureID(GLuint glTextureHandle);
 GLuint convertImTextureIDToGLTextureHandle(ImTextureID textureID);
 
 void RenderDrawLists(ImDrawData* draw_data); // rendering callback function prototype
+void SetupVertexPointers(const ImDrawVert* vtx_buffer);
 
 // Default mapping is XInput gamepad mapping
 void initDefaultJoystickMapping();
@@ -234,6 +237,8 @@ bool Init(sf::Window& window, const sf::Vector2f& displaySize, bool loadDefaultF
     io.BackendFlags |= ImGuiBackendFlags_HasGamepad;
     io.BackendFlags |= ImGuiBackendFlags_HasMouseCursors;
     io.BackendFlags |= ImGuiBackendFlags_HasSetMousePos;
+    // draw lists past 64K vertices are split into commands with a VtxOffset (see RenderDrawLists)
+    io.BackendFlags |= ImGuiBackendFlags_RendererHasVtxOffset;
     io.BackendPlatformName = "imgui_impl_sfml";
 
     s_currWindowCtx->joystickId = getConnectedJoystickId();
@@ -865,8 +870,18 @@ void SetupRenderState(ImDrawData* draw_data, int fb_width, int fb_height) {
     glLoadIdentity();
 }
 
+void SetupVertexPointers(const ImDrawVert* vtx_buffer) {
+    glVertexPointer(2, GL_FLOAT, sizeof(ImDrawVert),
+                    (const GLvoid*)((const char*)vtx_buffer + IM_OFFSETOF(ImDrawVert, pos)));
+    glTexCoordPointer(2, GL_FLOAT, sizeof(ImDrawVert),
+                      (const GLvoid*)((const char*)vtx_buffer + IM_OFFSETOF(ImDrawVert, uv)));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(ImDrawVert),
+                   (const GLvoid*)((const char*)vtx_buffer + IM_OFFSETOF(ImDrawVert, col)));
+}
+
 // Rendering callback
 void RenderDrawLists(ImDrawData* draw_data) {
+    TILE_TRACE_SCOPE("RenderDrawLists");
     ImGui::GetDrawData();
     if (draw_data->CmdListsCount == 0) {
         return;
@@ -917,14 +932,11 @@ void RenderDrawLists(ImDrawData* draw_data) {
     // Render command lists
     for (int n = 0; n < draw_data->CmdListsCount; n++) {
         const ImDrawList* cmd_list = draw_data->CmdLists[n];
-        const ImDrawVert* vtx_buffer = cmd_list->VtxBuffer.Data;
         const ImDrawIdx* idx_buffer = cmd_list->IdxBuffer.Data;
-        glVertexPointer(2, GL_FLOAT, sizeof(ImDrawVert),
-                        (const GLvoid*)((const char*)vtx_buffer + IM_OFFSETOF(ImDrawVert, pos)));
-        glTexCoordPointer(2, GL_FLOAT, sizeof(ImDrawVert),
-                          (const GLvoid*)((const char*)vtx_buffer + IM_OFFSETOF(ImDrawVert, uv)));
-        glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(ImDrawVert),
-                       (const GLvoid*)((const char*)vtx_buffer + IM_OFFSETOF(ImDrawVert, col)));
+        // Indices of a command are relative to its VtxOffset, the vertex pointers are only
+        // re-specified when that offset changes (once per 64K vertices with 16-bit indices)
+        unsigned int bound_vtx_offset = 0;
+        SetupVertexPointers(cmd_list->VtxBuffer.Data);
 
         for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++) {
             const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
@@ -951,6 +963,11 @@ void RenderDrawLists(ImDrawData* draw_data) {
                     glScissor((int)clip_rect.x, (int)(static_cast<float>(fb_height) - clip_rect.w),
                               (int)(clip_rect.z - clip_rect.x), (int)(clip_rect.w - clip_rect.y));
 
+                    if (pcmd->VtxOffset != bound_vtx_offset) {
+                        bound_vtx_offset = pcmd->VtxOffset;
+                        SetupVertexPointers(cmd_list->VtxBuffer.Data + bound_vtx_offset);
+                    }
+
                     // Bind texture, Draw
                     const GLuint textureHandle =
                         convertImTextureIDToGLTextureHandle(pcmd->TextureId);
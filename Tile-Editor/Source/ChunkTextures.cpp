@@ -0,0 +1,44 @@
+#include "ChunkTextures.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+ImTextureID ChunkTextures::getTexture(int chunkRow, int chunkCol, const CompositeChunk& chunk)
+{
+    uint64_t key = static_cast<uint64_t>(static_cast<uint32_t>(chunkRow)) << 32 | static_cast<uint32_t>(chunkCol);
+    Entry& entry = m_textures[key];
+    entry.lastUse = m_frame;
+    if (entry.revision != chunk.revision)
+    {
+        if (entry.revision == 0)
+            entry.texture.create(TILE_CHUNK_SIZE, TILE_CHUNK_SIZE);
+        //Composite pixels are RGBA8 in memory order, the layout SFML uploads
+        entry.texture.update(reinterpret_cast<const sf::Uint8*>(chunk.pixels.data()));
+        entry.revision = chunk.revision;
+        ++m_uploads;
+    }
+
+    //Same conversion as the ImGui-SFML backend, which reads the GL name back out of the id
+    unsigned int handle = entry.texture.getNativeHandle();
+    ImTextureID textureId = nullptr;
+    std::memcpy(&textureId, &handle, sizeof(handle));
+    return textureId;
+}
+
+void ChunkTextures::endFrame(size_t maxTextures)
+{
+    if (m_textures.size() > maxTextures)
+    {
+        std::vector<std::pair<uint32_t, uint64_t>> unused;
+        for (const auto& texture : m_textures)
+        {
+            if (texture.second.lastUse != m_frame)
+                unused.push_back({ texture.second.lastUse, texture.first });
+        }
+        std::sort(unused.begin(), unused.end());
+        for (size_t i = 0; i < unused.size() && m_textures.size() > maxTextures; ++i)
+            m_textures.erase(unused[i].second);
+    }
+    ++m_frame;
+}
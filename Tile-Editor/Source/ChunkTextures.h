@@ -0,0 +1,47 @@
+#pragma once
+#include <SFML/Graphics/Texture.hpp>
+#include "Compositor.h"
+#include <cstdint>
+#include <unordered_map>
+
+//SFML textures of the compositor's chunks, one TILE_CHUNK_SIZE x TILE_CHUNK_SIZE texture per chunk
+//drawn stretched over it. A texture is uploaded again only when its composite changed.
+class ChunkTextures : public CompositeTextures
+{
+private:
+    struct Entry
+    {
+        sf::Texture texture;
+        uint64_t revision = 0;
+        uint32_t lastUse = 0;
+    };
+
+    std::unordered_map<uint64_t, Entry> m_textures;
+    uint32_t m_frame = 1;
+    size_t m_uploads = 0;
+
+public:
+    ImTextureID getTexture(int chunkRow, int chunkCol, const CompositeChunk& chunk) override;
+
+    //Call once per frame after rendering. Textures not used this frame are released, oldest
+    //first, down to maxTextures.
+    void endFrame(size_t maxTextures);
+
+    //Releases every texture. Call it when the grid is replaced: the new grid's compositor numbers
+    //its revisions from the start again, which could match the textures of the old one.
+    void clear()
+    {
+        m_textures.clear();
+    }
+
+    size_t getTextureCount() const
+    {
+        return m_textures.size();
+    }
+
+    //Number of texture uploads since the start
+    size_t getUploadCount() const
+    {
+        return m_uploads;
+    }
+};
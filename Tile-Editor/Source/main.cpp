@@ -1,196 +1,34 @@
 #include <SFML/Graphics.hpp>
 #include <imgui.h>
 #include <imgui-SFML.h>
+#include "Autosave.h"
+#include "Brush.h"
+#include "ChunkTextures.h"
+#include "FrameProfiler.h"
+#include "Grid.h"
+#include "ProjectFile.h"
+#include "Selection.h"
+#include "Shape.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
-#include <unordered_map>
 #include <string>
+#include <vector>
 
-template<>
-struct std::hash<std::tuple<int, int, int>> {
-    size_t operator()(const std::tuple<int, int, int>  cellCoord) const
-    {
-        return std::hash<int>()(get<0>(cellCoord)) ^ std::hash<int>()(get<1>(cellCoord)) ^ std::hash<int>()(get<2>(cellCoord));// std::hash<int>()(cellCoord.second.second);
-    }
-};
-
-
-class TileLayer
+//SFML 2.5 has no waitEvent timeout: sleep between polls until an event arrives or the timeout
+//elapses. Sleeping keeps an idle editor off the CPU like a blocking wait would.
+bool waitEvent(sf::Window& window, sf::Event& event, sf::Time timeout)
 {
-private:
-    std::unordered_map<std::tuple<int, int, int>, ImVec4> m_cellColors;
-    bool m_isVisible;
-
-public:
-    TileLayer(bool isVisible = true) : m_isVisible(isVisible)
+    sf::Clock waited;
+    while (!window.pollEvent(event))
     {
+        if (waited.getElapsedTime() >= timeout)
+            return false;
+        sf::sleep(sf::milliseconds(5));
     }
-
-    void setTile(int pensize, int row, int col, const ImVec4& color) {
-        m_cellColors[std::make_tuple(pensize, row, col)] = color;
-    }
-
-    ImVec4 getTile(int pensize, int row, int col) const
-    {
-        auto it = m_cellColors.find(std::make_tuple(pensize, row, col));
-        if (it != m_cellColors.end())
-            return it->second;
-        else
-            return ImVec4(0, 0, 0, 0);
-    }
-
-    void setVisibility(bool visible) 
-    {
-        m_isVisible = visible;
-    }
-
-    bool getVisibility() const
-    {
-        return m_isVisible;
-    }
-
-    bool& isVisible() 
-    {
-        return m_isVisible;
-    }
-};
-
-
-class Grid
-{
-private:
-    ImVec2 m_canvasSize;
-    ImVec2 m_cellSize;
-    int m_numRows;
-    int m_numCols;
-    std::unordered_map<int, TileLayer> m_tileLayers;
-    int m_selectedLayer = 1;
-
-public:
-    Grid(ImVec2 canvasSize, ImVec2 cellSize) : 
-        m_canvasSize(canvasSize), 
-        m_cellSize(cellSize), 
-        m_numRows(static_cast<int>(m_canvasSize.y / m_cellSize.y)),
-        m_numCols(static_cast<int>(m_canvasSize.x / m_cellSize.x)),
-        m_tileLayers{ {1, TileLayer()}}
-    {
-    }
-
-    void render(ImDrawList* drawList, ImVec2 cellSize, int highlightCellX, int highlightCellY, bool showGrid, float gridThickness) {
-        ImVec2 windowPos = ImGui::GetCursorScreenPos();
-
-        m_cellSize = cellSize;
-        //Draws only visible layers. New Layers are drawn on Top of Old ones
-        for (const auto& layer : m_tileLayers)
-        {
-            if (layer.second.getVisibility() == true)
-            {
-                for (int row = 0; row < m_numRows; ++row)
-                {
-                    for (int col = 0; col < m_numCols; ++col)
-                    {
-                        for (int i = 8; i <= 128; i *= 2)
-                        {
-                            ImVec4 cellColor = layer.second.getTile(i, row, col);
-                            ImVec4 color = { 0,0,0,0 };
-                            float cellX = windowPos.x + col * i;
-                            float cellY = windowPos.y + row * i;
-                            drawList->AddRectFilled(ImVec2(cellX, cellY), ImVec2(cellX + i, cellY + i), ImGui::ColorConvertFloat4ToU32(cellColor));
-
-                        }
-                    }
-                }
-            }
-        }
-        if (showGrid) {
-
-            // Render horizontal grid lines
-            drawList->AddLine(ImVec2(windowPos.x, windowPos.y), ImVec2(windowPos.x + m_canvasSize.x, windowPos.y), IM_COL32(150, 150, 150, 255), gridThickness);
-            for (float y = windowPos.y + m_cellSize.y - 1; y < windowPos.y + m_canvasSize.y; y += m_cellSize.y) {
-                drawList->AddLine(ImVec2(windowPos.x, y), ImVec2(windowPos.x + m_canvasSize.x, y), IM_COL32(150, 150, 150, 255), gridThickness);
-            }
-
-            // Render vertical grid lines
-            drawList->AddLine(ImVec2(windowPos.x, windowPos.y), ImVec2(windowPos.x, windowPos.y + m_canvasSize.y), IM_COL32(150, 150, 150, 255), gridThickness);
-            for (float x = windowPos.x + m_cellSize.x - 1; x < windowPos.x + m_canvasSize.x; x += m_cellSize.x) {
-                drawList->AddLine(ImVec2(x, windowPos.y), ImVec2(x, windowPos.y + m_canvasSize.y), IM_COL32(150, 150, 150, 255), gridThickness);
-            }
-        }
-               
-    }
-    void setCellColor(int pensize, int row, int col, const ImVec4& color) {
-
-        //Mouse draws only on selected layer ID.
-        //selected layer ID is first searched in TileLayers to be modified.
-        if (m_selectedLayer != -1)
-        {
-            auto it = m_tileLayers.find(m_selectedLayer);
-            if (it != m_tileLayers.end())
-            {
-                it->second.setTile(pensize, row, col, color);
-            }
-        }
-    }
-
-    void drawLayerWindow() {
-        ImGui::SetNextWindowSizeConstraints(ImVec2(250, -1), ImVec2(FLT_MAX, -1));
-        ImGui::Begin("Layers", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
-
-        for (auto it = m_tileLayers.begin(); it != m_tileLayers.end(); ++it)
-        {
-            int layerNumber = it->first; 
-            bool isSelected = (m_selectedLayer == layerNumber);
-
-            ImGui::Checkbox(("##" + std::to_string(layerNumber)).c_str(), &(it->second.isVisible()));
-
-            ImGui::SameLine();
-            if (ImGui::Selectable(("Layer : " + std::to_string(layerNumber)).c_str(), isSelected)) {
-                m_selectedLayer = layerNumber;
-            }
-            
-        }
-        if (ImGui::Button("Add"))
-        {
-
-            for (int i = 1; i <= m_tileLayers.size() + 1; i++)
-            {
-                if (m_tileLayers.find(i) == m_tileLayers.end())
-                {
-                    m_tileLayers.insert({ i, TileLayer() });
-                    m_selectedLayer = i;
-                    break;
-                }
-            }
-        }
-        ImGui::SameLine();
-
-        if (ImGui::Button("Delete"))
-        {
-            auto it = m_tileLayers.find(m_selectedLayer);
-            if (it != m_tileLayers.end())
-            {
-                auto prevIt = (it == m_tileLayers.begin()) ? m_tileLayers.end() : std::prev(it);
-                auto layer = m_tileLayers.erase(it);
-                if (layer != m_tileLayers.end())
-                {
-                    m_selectedLayer = layer->first;
-                }
-                else 
-                {
-                    if (prevIt != m_tileLayers.end())
-                    {
-                        m_selectedLayer = prevIt->first;
-                    }
-                    else
-                    {
-                        m_selectedLayer = 0;
-                    }
-                }               
-            }
-            
-        }
-        ImGui::End();
-    }
-};
+    return true;
+}
 
 int main() 
 {
@@ -209,17 +47,31 @@ int main()
 
     Grid grid(canvasSize, cellSize);
 
+    //Visible layers are flattened per chunk on the CPU and drawn as one texture per chunk.
+    //A grid replaced by Open or crash recovery starts without textures and a fresh compositor,
+    //so the textures are attached to it again and the old ones dropped.
+    ChunkTextures chunkTextures;
+    bool compositeLayers = true;
+    auto attachCompositeTextures = [&]() {
+        chunkTextures.clear();
+        grid.setCompositeTextures(compositeLayers ? &chunkTextures : nullptr);
+    };
+    attachCompositeTextures();
+
     //Grid Thickness init
     const char* gridThicknessLabel[] = { "1x", "2x", "3x", "4x" };
     float selectedGridThickness = 0;
 
-    //Pen Size init
-    const char* penSizeLabel[] = { "1x", "2x", "3x", "4x" };
-    int selectedPenSize = 0;
+    //Brush init. A pen cell is one grid cell, the brush is rebuilt only when its shape or size changes.
     ImVec2 penSize(cellSizePixel, cellSizePixel);
+    BrushShape brushShape = BrushShape::Square;
+    int brushSize = 1;
+    Brush brush(brushShape, brushSize);
 
-    // Default selected color in Color Palette
+    // Default selected color in Color Palette.
+    // The picker edits floats, tiles are stored packed: selectedTileColor is only converted when the picker changes.
     ImVec4 selectedColor(1.0f, 0.0f, 0.0f, 1.0f); 
+    ImU32 selectedTileColor = ImGui::ColorConvertFloat4ToU32(selectedColor);
     int highlightCellX = -1; 
     int highlightCellY = -1;
 
@@ -229,12 +81,74 @@ int main()
     bool m_leftMouseButtonPressed = false;
     bool m_rightMouseButtonPressed = false;
 
+    //Idle mode: when nothing happens the loop blocks for input instead of redrawing.
+    //A few frames are still drawn after each event so ImGui can settle hover and layout,
+    //and the timeout keeps ImGui animations such as the text cursor alive.
+    bool idleWhenInactive = true;
+    int frameRateCap = 60;
+    int pendingFrames = 0;
+    const int framesAfterEvent = 3;
+    const sf::Time idleTimeout = sf::milliseconds(500);
+    window.setFramerateLimit(frameRateCap);
+
+    FrameProfiler profiler;
+    bool showProfiler = false;
+
+    char projectPath[256] = "map.tileproj";
+
+    //Pen paints strokes, Bucket fills the region under the cursor on a click,
+    //shape tools are dragged out with a preview and written on release, Select drags out a
+    //selection which is moved by dragging it
+    enum class Tool { Pen, Bucket, Rectangle, Ellipse, Line, Select };
+    Tool selectedTool = Tool::Pen;
+    bool fillDiagonal = false;
+    bool fillSampleVisible = false;
+    bool shapeFilled = false;
+    bool shapeDragging = false;
+    bool shapeErasing = false;
+    int shapeAnchorRow = 0;
+    int shapeAnchorCol = 0;
+    std::vector<TileSpan> shapeSpans;
+    TileSelection selection;
+    bool selectDragging = false;
+    bool selectMoving = false;
+    int selectAnchorRow = 0;
+    int selectAnchorCol = 0;
+
+    //Everything painted while a mouse button is held is undone as one step
+    bool stroking = false;
+    int historyCapMB = static_cast<int>(grid.getHistory().getMemoryCap() >> 20);
+
+    //Resident chunk budget, chunks beyond it are paged out to disk. 0 keeps every chunk in memory.
+    int chunkBudgetMB = 512;
+    grid.setChunkBudget(static_cast<size_t>(chunkBudgetMB) << 20);
+
+    //Changed chunks are journaled in the background; a journal left behind by a crash is replayed
+    Autosave autosave("autosave.journal");
+    if (autosave.recover(grid))
+    {
+        canvasSize = grid.getCanvasSize();
+        attachCompositeTextures();
+    }
+    else
+        autosave.restart(grid);
+
     sf::Clock deltaTime;
     while (window.isOpen()) 
     {
         sf::Event event;
-        while (window.pollEvent(event)) 
+        bool idle = idleWhenInactive && pendingFrames == 0 && !m_mouseButtonPressed;
+        //Time spent blocked for input is not part of the frame
+        bool hasEvent = idle && waitEvent(window, event, idleTimeout);
+        profiler.beginFrame();
+        pendingFrames = std::max(pendingFrames - 1, 0);
+
+        profiler.beginPhase(FramePhase::Events);
+        if (!idle)
+            hasEvent = window.pollEvent(event);
+        while (hasEvent) 
         {
+            pendingFrames = framesAfterEvent;
             ImGui::SFML::ProcessEvent(event);
 
             switch (event.type)
@@ -294,9 +208,12 @@ int main()
             default:
                 break;
             }
+            hasEvent = window.pollEvent(event);
         }
 
+        profiler.beginPhase(FramePhase::Update);
         ImGui::SFML::Update(window, deltaTime.restart());
+        profiler.endPhase();
 
         window.clear(sf::Color(18, 33, 43));
 
@@ -305,43 +222,213 @@ int main()
         ImGui::BeginChild("GridChild", ImVec2(canvasSize.x, canvasSize.y), false, ImGuiWindowFlags_NoScrollbar);
 
         ImDrawList* drawList = ImGui::GetWindowDrawList();
+        profiler.beginPhase(FramePhase::GridRender);
         grid.render(drawList, cellSize, highlightCellX, highlightCellY, showGrid, selectedGridThickness + 1);
+        profiler.beginPhase(FramePhase::LayerWindow);
         grid.drawLayerWindow();
+        profiler.endPhase();
+
+
+        if (m_mouseButtonPressed != stroking)
+        {
+            stroking = m_mouseButtonPressed;
+            if (stroking)
+                grid.beginStroke();
+            else
+                grid.endStroke();
+        }
+
+        if (selectedTool == Tool::Bucket && ImGui::IsWindowHovered() &&
+            (ImGui::IsMouseClicked(ImGuiMouseButton_Left) || ImGui::IsMouseClicked(ImGuiMouseButton_Right)))
+        {
+            //Fills work in tiles, whatever the pen size
+            ImVec2 canvasPos = ImGui::GetCursorScreenPos();
+            ImVec2 mousePos = ImGui::GetMousePos();
+            ImVec2 tileSize = grid.getTileSize();
+            ImU32 fillColor = ImGui::IsMouseClicked(ImGuiMouseButton_Left) ? selectedTileColor : IM_COL32_BLACK_TRANS;
+            grid.floodFill(static_cast<int>((mousePos.y - canvasPos.y) / tileSize.y), static_cast<int>((mousePos.x - canvasPos.x) / tileSize.x),
+                fillColor, fillDiagonal, fillSampleVisible);
+        }
+        else if (selectedTool == Tool::Rectangle || selectedTool == Tool::Ellipse || selectedTool == Tool::Line)
+        {
+            //Shapes work in tiles, whatever the pen size
+            ImVec2 canvasPos = ImGui::GetCursorScreenPos();
+            ImVec2 mousePos = ImGui::GetMousePos();
+            ImVec2 tileSize = grid.getTileSize();
+            int tileRow = static_cast<int>(std::floor((mousePos.y - canvasPos.y) / tileSize.y));
+            int tileCol = static_cast<int>(std::floor((mousePos.x - canvasPos.x) / tileSize.x));
+            if (!shapeDragging && ImGui::IsWindowHovered() &&
+                (ImGui::IsMouseClicked(ImGuiMouseButton_Left) || ImGui::IsMouseClicked(ImGuiMouseButton_Right)))
+            {
+                shapeDragging = true;
+                shapeErasing = ImGui::IsMouseClicked(ImGuiMouseButton_Right);
+                shapeAnchorRow = tileRow;
+                shapeAnchorCol = tileCol;
+            }
+            if (shapeDragging)
+            {
+                ShapeKind kind = selectedTool == Tool::Line ? ShapeKind::Line :
+                    selectedTool == Tool::Rectangle ? (shapeFilled ? ShapeKind::FilledRectangle : ShapeKind::Rectangle) :
+                    (shapeFilled ? ShapeKind::FilledEllipse : ShapeKind::Ellipse);
+                rasterizeShape(kind, shapeAnchorRow, shapeAnchorCol, tileRow, tileCol, shapeSpans);
+                if (ImGui::IsMouseReleased(shapeErasing ? ImGuiMouseButton_Right : ImGuiMouseButton_Left))
+                {
+                    grid.paintSpans(shapeSpans, shapeErasing ? IM_COL32_BLACK_TRANS : selectedTileColor);
+                    shapeDragging = false;
+                }
+                else
+                {
+                    //The layer is only written on release, until then the shape is a handful of quads on top
+                    Grid::appendSpans(drawList, shapeSpans, canvasPos, tileSize, shapeErasing ? IM_COL32(0, 0, 0, 128) : selectedTileColor);
+                }
+            }
+        }
+        else if (selectedTool == Tool::Select)
+        {
+            //Selections work in tiles, whatever the pen size
+            ImVec2 canvasPos = ImGui::GetCursorScreenPos();
+            ImVec2 mousePos = ImGui::GetMousePos();
+            ImVec2 tileSize = grid.getTileSize();
+            int tileRow = static_cast<int>(std::floor((mousePos.y - canvasPos.y) / tileSize.y));
+            int tileCol = static_cast<int>(std::floor((mousePos.x - canvasPos.x) / tileSize.x));
+            if (ImGui::IsWindowHovered() && ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+            {
+                //Dragging the selection moves its cells, dragging elsewhere selects anew
+                if (selection.contains(tileRow, tileCol))
+                {
+                    selection.lift(grid);
+                    selectMoving = true;
+                }
+                else
+                {
+                    selectDragging = true;
+                }
+                selectAnchorRow = tileRow;
+                selectAnchorCol = tileCol;
+            }
+            else if (ImGui::IsWindowHovered() && ImGui::IsMouseClicked(ImGuiMouseButton_Right))
+            {
+                selection.deselect(grid);
+            }
 
-        
-        if (m_mouseButtonPressed && showGrid)
+            if (selectDragging)
+            {
+                selection.select(grid, selectAnchorRow, selectAnchorCol, tileRow, tileCol);
+            }
+            else if (selectMoving)
+            {
+                selection.moveBy(tileRow - selectAnchorRow, tileCol - selectAnchorCol);
+                selectAnchorRow = tileRow;
+                selectAnchorCol = tileCol;
+            }
+
+            if (ImGui::IsMouseReleased(ImGuiMouseButton_Left))
+            {
+                //A click without a drag selects nothing
+                if (selectDragging && tileRow == selectAnchorRow && tileCol == selectAnchorCol)
+                    selection.deselect(grid);
+                selectDragging = false;
+                selectMoving = false;
+            }
+        }
+        else if (selectedTool == Tool::Pen && m_mouseButtonPressed && showGrid)
         {
             windowPos = ImGui::GetCursorScreenPos();
             sf::Vector2i mousePos = sf::Mouse::getPosition(window);
           
             if (mousePos.x >= windowPos.x && mousePos.x < windowPos.x + canvasSize.x &&
-                mousePos.y >= windowPos.y && mousePos.y < windowPos.y + canvasSize.y) {
-                
-                for (int i = -1; i <= -1 + selectedPenSize; ++i)
-                {
-                    for (int j = -1; j <= -1 + selectedPenSize; ++j)
-                    {
-                        highlightCellX = static_cast<int>((mousePos.x - windowPos.x) / penSize.x);
-                        highlightCellY = static_cast<int>((mousePos.y - windowPos.y) / penSize.y);
-
-                        if (m_leftMouseButtonPressed && ImGui::IsWindowHovered())
-                            grid.setCellColor(penSize.x, highlightCellY + i + 1, highlightCellX + j + 1, selectedColor);
-                        else if (m_rightMouseButtonPressed && ImGui::IsWindowHovered())
-                            grid.setCellColor(penSize.x, highlightCellY + i + 1, highlightCellX + j + 1, { 0,0,0,0 });
-
-                    }
-                }
-                
+                mousePos.y >= windowPos.y && mousePos.y < windowPos.y + canvasSize.y && ImGui::IsWindowHovered()) {
+                TILE_TRACE_SCOPE_ARG("brush stroke", "brush_size", brush.getSize());
+
+                //The stroke is joined to the previous frame's sample and skips pen cells it already painted
+                highlightCellX = static_cast<int>((mousePos.x - windowPos.x) / penSize.x);
+                highlightCellY = static_cast<int>((mousePos.y - windowPos.y) / penSize.y);
+                if (m_leftMouseButtonPressed)
+                    grid.strokeTo(penSize.x, brush, highlightCellY, highlightCellX, selectedTileColor);
+                else if (m_rightMouseButtonPressed)
+                    grid.strokeTo(penSize.x, brush, highlightCellY, highlightCellX, IM_COL32_BLACK_TRANS);
+            }
+            else
+            {
+                grid.breakStroke();
             }
         }
+        if (selectedTool == Tool::Pen && ImGui::IsWindowHovered())
+        {
+            //Brush footprint under the cursor, one rect per run of identical rows
+            ImVec2 canvasPos = ImGui::GetCursorScreenPos();
+            ImVec2 mousePos = ImGui::GetMousePos();
+            ImVec2 cellPos(canvasPos.x + std::floor((mousePos.x - canvasPos.x) / penSize.x) * penSize.x,
+                canvasPos.y + std::floor((mousePos.y - canvasPos.y) / penSize.y) * penSize.y);
+            Grid::appendSpans(drawList, brush.getSpans(), cellPos, penSize, IM_COL32(255, 255, 255, 64));
+        }
+        selection.render(grid, drawList);
         ImGui::EndChild();
         ImGui::End();
 
         //EDIT PANEL WINDOW
+        profiler.beginPhase(FramePhase::EditPanel);
         ImGui::Begin("Edit Panel");
-        ImGui::ColorEdit4("Selected Color", reinterpret_cast<float*>(&selectedColor), ImGuiColorEditFlags_NoInputs | ImGuiColorEditFlags_AlphaBar);
+        if (ImGui::ColorEdit4("Selected Color", reinterpret_cast<float*>(&selectedColor), ImGuiColorEditFlags_NoInputs | ImGuiColorEditFlags_AlphaBar))
+            selectedTileColor = ImGui::ColorConvertFloat4ToU32(selectedColor);
         ImGui::Checkbox("Show Grid", &showGrid);
 
+        // Tool
+        Tool previousTool = selectedTool;
+        if (ImGui::RadioButton("Pen", selectedTool == Tool::Pen))
+            selectedTool = Tool::Pen;
+        ImGui::SameLine();
+        if (ImGui::RadioButton("Bucket", selectedTool == Tool::Bucket))
+            selectedTool = Tool::Bucket;
+        ImGui::SameLine();
+        if (ImGui::RadioButton("Rectangle", selectedTool == Tool::Rectangle))
+            selectedTool = Tool::Rectangle;
+        ImGui::SameLine();
+        if (ImGui::RadioButton("Ellipse", selectedTool == Tool::Ellipse))
+            selectedTool = Tool::Ellipse;
+        ImGui::SameLine();
+        if (ImGui::RadioButton("Line", selectedTool == Tool::Line))
+            selectedTool = Tool::Line;
+        ImGui::SameLine();
+        if (ImGui::RadioButton("Select", selectedTool == Tool::Select))
+            selectedTool = Tool::Select;
+        if (selectedTool != previousTool)
+            selection.deselect(grid);
+        if (selectedTool == Tool::Rectangle || selectedTool == Tool::Ellipse)
+            ImGui::Checkbox("Filled", &shapeFilled);
+        if (selectedTool == Tool::Bucket)
+        {
+            ImGui::Checkbox("Diagonal", &fillDiagonal);
+            ImGui::SameLine();
+            ImGui::Checkbox("Sample Visible Layers", &fillSampleVisible);
+        }
+        if (selectedTool == Tool::Select)
+        {
+            if (ImGui::Button("Copy") || ImGui::IsKeyChordPressed(ImGuiMod_Ctrl | ImGuiKey_C))
+                selection.copy(grid);
+            ImGui::SameLine();
+            if (ImGui::Button("Cut") || ImGui::IsKeyChordPressed(ImGuiMod_Ctrl | ImGuiKey_X))
+                selection.cut(grid);
+            ImGui::SameLine();
+            if (ImGui::Button("Paste") || ImGui::IsKeyChordPressed(ImGuiMod_Ctrl | ImGuiKey_V))
+                selection.paste(grid);
+            ImGui::SameLine();
+            if (ImGui::Button("Delete") || ImGui::IsKeyPressed(ImGuiKey_Delete))
+                selection.erase(grid);
+            //The painted cells of the selection become a custom brush
+            if (ImGui::Button("Use As Brush") && selection.copy(grid))
+            {
+                brush = Brush(selection.getClipboard());
+                brushShape = BrushShape::Custom;
+                selection.deselect(grid);
+                selectedTool = Tool::Pen;
+            }
+            if (ImGui::IsKeyPressed(ImGuiKey_Enter))
+                selection.drop(grid);
+            if (ImGui::IsKeyPressed(ImGuiKey_Escape))
+                selection.deselect(grid);
+        }
+
 
         // Cell Size
         ImGui::Text(("Cell Size (x = " + std::to_string(static_cast<int>(cellSize.x)) + ")").c_str());
@@ -349,7 +436,6 @@ int main()
             ImGui::Selectable(cellSizeLabel[i].c_str(), selectedCellSize == i, ImGuiSelectableFlags_None, ImVec2(15, 0));
             if (ImGui::IsItemClicked()) {
                 selectedCellSize = i;
-                selectedPenSize = 0;
                 cellSize = ImVec2(cellSizePixel * std::stoi(cellSizeLabel[i], 0), cellSizePixel * std::stoi(cellSizeLabel[i], 0));
                 penSize = cellSize;
             }
@@ -374,26 +460,126 @@ int main()
         }
         ImGui::Spacing();
 
-        // Pen Size
-        ImGui::Text(("Pen Size (x = " + std::to_string(static_cast<int>(penSize.x)) + ")").c_str());
-        for (int i = 0; i < sizeof(penSizeLabel) / sizeof(penSizeLabel[0]); ++i) {
-            ImGui::Selectable(penSizeLabel[i], selectedPenSize == i, ImGuiSelectableFlags_None, ImVec2(15, 0));
-            if (ImGui::IsItemClicked()) {
-                selectedPenSize = i;
-            }
-            ImGui::SameLine();
-            ImGui::Spacing(); 
+        // Brush
+        bool brushChanged = false;
+        if (ImGui::RadioButton("Square", brushShape == BrushShape::Square))
+        {
+            brushShape = BrushShape::Square;
+            brushChanged = true;
+        }
+        ImGui::SameLine();
+        if (ImGui::RadioButton("Circle", brushShape == BrushShape::Circle))
+        {
+            brushShape = BrushShape::Circle;
+            brushChanged = true;
+        }
+        if (brushShape == BrushShape::Custom)
+        {
             ImGui::SameLine();
+            ImGui::RadioButton("Custom", true);
+        }
+        brushChanged |= ImGui::SliderInt("Brush Size", &brushSize, 1, Brush::MAX_SIZE);
+        if (brushChanged)
+        {
+            if (brushShape == BrushShape::Custom)
+                brushShape = BrushShape::Square;
+            brush = Brush(brushShape, brushSize);
+        }
 
+        // History
+        //Floating cells are dropped first, closing the step that lifted them
+        if ((ImGui::Button("Undo") || ImGui::IsKeyChordPressed(ImGuiMod_Ctrl | ImGuiKey_Z)) && !stroking)
+        {
+            selection.drop(grid);
+            grid.undo();
+        }
+        ImGui::SameLine();
+        if ((ImGui::Button("Redo") || ImGui::IsKeyChordPressed(ImGuiMod_Ctrl | ImGuiKey_Y)) && !stroking)
+        {
+            selection.drop(grid);
+            grid.redo();
+        }
+        ImGui::SameLine();
+        ImGui::Text(("Undo Steps : " + std::to_string(grid.getHistory().getUndoCount())).c_str());
+        if (ImGui::SliderInt("History Cap (MB)", &historyCapMB, 1, 1024))
+            grid.getHistory().setMemoryCap(static_cast<size_t>(historyCapMB) << 20);
+        ImGui::Text(("History : " + std::to_string(grid.getHistory().getMemoryBytes() >> 10) + " KB").c_str());
+
+        // Project
+        ImGui::InputText("Project", projectPath, sizeof(projectPath));
+        if (ImGui::Button("Save"))
+        {
+            selection.drop(grid);
+            if (!saveProject(grid, projectPath))
+                std::cerr << "Could not save " << projectPath << std::endl;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Open"))
+        {
+            selection.deselect(grid);
+            if (loadProject(projectPath, grid))
+            {
+                canvasSize = grid.getCanvasSize();
+                attachCompositeTextures();
+                autosave.restart(grid);
+            }
+            else
+                std::cerr << "Could not open " << projectPath << std::endl;
+        }
+        if (ImGui::SliderInt("Chunk Budget (MB)", &chunkBudgetMB, 0, 4096, chunkBudgetMB == 0 ? "Off" : "%d"))
+            grid.setChunkBudget(static_cast<size_t>(chunkBudgetMB) << 20);
+        ImGui::Text(("Resident Chunks : " + std::to_string(grid.getResidentChunkCount())).c_str());
+        bool autosaveEnabled = autosave.isEnabled();
+        if (ImGui::Checkbox("Autosave", &autosaveEnabled))
+            autosave.setEnabled(autosaveEnabled);
+        ImGui::SameLine();
+        ImGui::Text(("Journal : " + std::to_string(autosave.getJournalBytes() >> 10) + " KB" + (autosave.hasWriteFailed() ? " (write failed)" : "")).c_str());
+
+        // Redraw
+        ImGui::Checkbox("Idle When Inactive", &idleWhenInactive);
+        if (ImGui::SliderInt("FPS Cap", &frameRateCap, 0, 240, frameRateCap == 0 ? "Off" : "%d"))
+            window.setFramerateLimit(frameRateCap);
+
+        // Render stats
+        if (ImGui::Checkbox("Composite Layers", &compositeLayers))
+            attachCompositeTextures();
+        ImGui::Text(((compositeLayers ? "Chunk Textures : " : "Tile Quads : ") + std::to_string(grid.getEmittedQuadCount())).c_str());
+        if (compositeLayers)
+            ImGui::Text(("Texture Uploads : " + std::to_string(chunkTextures.getUploadCount())).c_str());
+        ImGui::Checkbox("Show Profiler", &showProfiler);
+#if defined(TILE_TRACE)
+        bool recordTrace = TraceRecorder::instance().isEnabled();
+        if (ImGui::Checkbox("Record Trace", &recordTrace))
+            TraceRecorder::instance().setEnabled(recordTrace);
+        ImGui::SameLine();
+        if (ImGui::Button("Write trace.json"))
+        {
+            if (!TraceRecorder::instance().writeChromeTrace("trace.json"))
+                std::cerr << "Could not write trace.json" << std::endl;
         }
+        ImGui::Text(("Trace Events : " + std::to_string(TraceRecorder::instance().getEventCount())).c_str());
+#endif
 
         ImGui::End();
+        profiler.endPhase();
+
+        if (showProfiler)
+            profiler.drawWindow(&showProfiler);
+
+        //Everything rendered or painted this frame is in the working set, the rest may be paged out
+        grid.trimResidentChunks();
+        chunkTextures.endFrame(4096);
+        autosave.update(grid);
 
+        profiler.beginPhase(FramePhase::Render);
         ImGui::SFML::Render(window);
 
+        profiler.beginPhase(FramePhase::Display);
         window.display();
+        profiler.endFrame();
     }
 
+    autosave.close();
     ImGui::SFML::Shutdown();
     return 0;
 }
@@ -0,0 +1,133 @@
+#include "Compositor.h"
+#include <cstdio>
+#include <random>
+#include <vector>
+
+//Checks the compositor's blend kernels, run by ctest: blendOverScalar against the rounding it
+//documents, and every SIMD kernel compiled in against blendOverScalar, bit for bit. Pixels mix
+//random values with the edge alphas 0, 128 and 255, and runs of every length up to a few vectors
+//start at every offset, so the scalar tails of the SIMD loops are covered too.
+
+namespace
+{
+    constexpr int PIXELS = 1 << 16;
+    const uint32_t EDGE_ALPHAS[] = { 0, 128, 255 };
+
+    uint32_t pickAlpha(std::mt19937& rng)
+    {
+        return rng() % 2 == 0 ? EDGE_ALPHAS[rng() % 3] : rng() % 256;
+    }
+
+    //Channel values of 0, max and random ones, at most max
+    uint32_t pickChannel(std::mt19937& rng, uint32_t max)
+    {
+        switch (rng() % 4)
+        {
+        case 0:
+            return 0;
+        case 1:
+            return max;
+        default:
+            return rng() % (max + 1);
+        }
+    }
+
+    //x / 255 rounded to nearest, as a reference for the kernels' shift based division
+    uint32_t roundedDiv255(uint32_t x)
+    {
+        return (2 * x + 255) / 510;
+    }
+
+    uint32_t referenceBlend(uint32_t dst, ImU32 src)
+    {
+        const uint32_t alpha = src >> IM_COL32_A_SHIFT;
+        uint32_t blended = 0;
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            uint32_t factor = shift == IM_COL32_A_SHIFT ? 255 : alpha;
+            blended |= (roundedDiv255(((src >> shift) & 0xFF) * factor) + roundedDiv255(((dst >> shift) & 0xFF) * (255 - alpha))) << shift;
+        }
+        return blended;
+    }
+
+    bool checkKernel(const char* name, void (*blend)(uint32_t*, const ImU32*, int),
+        const std::vector<ImU32>& source, const std::vector<uint32_t>& base)
+    {
+        std::vector<uint32_t> expected = base;
+        blendOverScalar(expected.data(), source.data(), PIXELS);
+
+        std::vector<uint32_t> pixels = base;
+        blend(pixels.data(), source.data(), PIXELS);
+        for (int i = 0; i < PIXELS; ++i)
+        {
+            if (pixels[i] != expected[i])
+            {
+                std::fprintf(stderr, "%s: pixel %d is %08X over %08X -> %08X, blendOverScalar gives %08X\n",
+                    name, i, source[i], base[i], pixels[i], expected[i]);
+                return false;
+            }
+        }
+
+        for (int offset = 0; offset < 8; ++offset)
+        {
+            for (int count = 0; count <= 40; ++count)
+            {
+                pixels = base;
+                blend(pixels.data() + offset, source.data() + offset, count);
+                for (int i = 0; i < 64; ++i)
+                {
+                    bool inRun = i >= offset && i < offset + count;
+                    if (pixels[i] != (inRun ? expected[i] : base[i]))
+                    {
+                        std::fprintf(stderr, "%s: run of %d pixels at %d is wrong at pixel %d\n", name, count, offset, i);
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+}
+
+int main()
+{
+    std::mt19937 rng(25);
+    std::vector<ImU32> source(PIXELS);
+    std::vector<uint32_t> base(PIXELS);
+    for (int i = 0; i < PIXELS; ++i)
+    {
+        source[i] = pickAlpha(rng) << IM_COL32_A_SHIFT;
+        for (int shift = 0; shift < IM_COL32_A_SHIFT; shift += 8)
+            source[i] |= pickChannel(rng, 255) << shift;
+
+        //Premultiplied destination: no channel above alpha
+        uint32_t alpha = pickAlpha(rng);
+        base[i] = alpha << IM_COL32_A_SHIFT;
+        for (int shift = 0; shift < IM_COL32_A_SHIFT; shift += 8)
+            base[i] |= pickChannel(rng, alpha) << shift;
+    }
+
+    bool passed = true;
+    std::vector<uint32_t> pixels = base;
+    blendOverScalar(pixels.data(), source.data(), PIXELS);
+    for (int i = 0; i < PIXELS && passed; ++i)
+    {
+        if (pixels[i] != referenceBlend(base[i], source[i]))
+        {
+            std::fprintf(stderr, "blendOverScalar: pixel %d is %08X over %08X -> %08X, expected %08X\n",
+                i, source[i], base[i], pixels[i], referenceBlend(base[i], source[i]));
+            passed = false;
+        }
+    }
+
+#if defined(TILE_SSE2)
+    passed &= checkKernel("blendOverSse2", blendOverSse2, source, base);
+#endif
+#if defined(TILE_AVX2)
+    passed &= checkKernel("blendOverAvx2", blendOverAvx2, source, base);
+#endif
+    passed &= checkKernel("blendOverRow", blendOverRow, source, base);
+
+    std::printf("%s\n", passed ? "blend kernels match" : "blend kernels differ");
+    return passed ? 0 : 1;
+}